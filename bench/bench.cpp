@@ -0,0 +1,271 @@
+// bench: measures the supervisor's process layer against fake-frpc
+// instances, so no frp server is needed.
+//
+//   bench [--fake PATH] [--mode run|slow-term|ignore-term] [--flood BYTES_PER_SEC] [COUNT...]
+//
+// For every COUNT (default 1 10 100 1000) a fresh ProcessManager starts that
+// many instances, kills a sample of them one by one to time how long the
+// event loop takes to reap an exit and restart it, optionally lets them flood
+// their logs for a second, and shuts everything down. The supervisor's own
+// output goes to /dev/null, the report to stdout.
+//
+// Every heap allocation made from the moment the instances are up until the
+// shutdown has completed is counted. That window covers the process layer
+// only (reaping, restarting, logging and shutdown), which must not allocate;
+// bench exits with 1 when it did. supervise-alloc checks the same for the
+// whole supervisor loop.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#include "process/event_loop.h"
+#include "process/process_manager.h"
+
+namespace {
+
+size_t g_allocations = 0; // the supervisor is single threaded
+
+} // namespace
+
+void *operator new(size_t size) {
+    g_allocations += 1;
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string fake;
+    std::string mode = "run";
+    long flood = 0;
+    std::vector<int> counts;
+};
+
+struct Result {
+    int instances = 0;
+    double start_ms = 0;
+    double reap_p50_us = 0;
+    double reap_p99_us = 0;
+    double reap_max_us = 0;
+    double shutdown_ms = 0;
+    long rss_kb = 0;
+    double cpu_us_per_event = 0;
+    size_t events = 0;
+    size_t allocations = 0;
+};
+
+double micros(Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+long rss_kb() {
+    std::ifstream statm("/proc/self/statm");
+    long size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+double cpu_us() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    const auto us = [](const timeval &tv) { return tv.tv_sec * 1e6 + tv.tv_usec; };
+    return us(usage.ru_utime) + us(usage.ru_stime);
+}
+
+// The dispatch of App::supervise(), minus signals and the control socket.
+// Returns the number of events handled once `done()` holds.
+template <typename Done>
+size_t pump(EventLoop &loop, ProcessManager &manager, Done &&done) {
+    size_t handled = 0;
+    while (!done()) {
+        EventLoop::Event events[16];
+        const size_t count = loop.poll(events);
+        for (size_t i = 0; i < count; ++i) {
+            const auto token = events[i].token;
+            switch (token_source(token)) {
+                case Source::CHILD: manager.on_child_event(token_index(token)); break;
+                case Source::SHUTDOWN: manager.kill_remaining(); break;
+                case Source::RESTART: manager.on_restart_due(token_index(token)); break;
+                case Source::LOG: manager.on_log_event(token_index(token)); break;
+                case Source::STOP_DEADLINE: manager.on_stop_deadline(token_index(token)); break;
+                case Source::LAUNCH: manager.on_launch_due(); break;
+                default: break;
+            }
+        }
+        handled += count;
+    }
+    return handled;
+}
+
+bool run(const Options &options, const std::filesystem::path &dir, int instances, Result &result) {
+    const auto config = (dir / "fake.toml").string();
+    {
+        std::ofstream file(config);
+        file << "mode = \"" << options.mode << "\"\n"
+             << "term_delay_ms = 500\n"
+             << "flood_bytes_per_sec = " << options.flood << "\n";
+    }
+
+    ProcessManager manager;
+    manager.reserve(static_cast<size_t>(instances));
+    for (int i = 0; i < instances; ++i) {
+        const auto name = "fake-" + std::to_string(i);
+        InstanceOptions instance;
+        // respawn right away, the killed samples must not look like a crash loop
+        instance.restart = {.mode = RestartMode::ALWAYS, .initial_backoff_ms = 0, .jitter = 0, .max_restarts = instances};
+        if (options.flood > 0) {
+            instance.log.path = (dir / (name + ".log")).string();
+            instance.log.max_files = 1;
+        }
+        const std::string args[] = {options.fake, "-c", config};
+        manager.add_process(name, args, instance);
+    }
+
+    result.instances = instances;
+    const auto begin = Clock::now();
+    if (!manager.start_all()) return false;
+    result.start_ms = micros(Clock::now() - begin) / 1000;
+    result.rss_kb = rss_kb();
+
+    EventLoop loop;
+    if (!loop.is_valid()) return false;
+    manager.watch(loop);
+    loop.reserve(1); // the flood timer below
+    const int samples = std::min(instances, 50);
+    std::vector<double> reaps;
+    reaps.reserve(static_cast<size_t>(samples));
+    const double cpu_before = cpu_us();
+    const size_t allocations_before = g_allocations;
+
+    // reap latency: SIGKILL one child at a time and wait for the loop to see
+    // it, then for the restart policy to bring it back
+    for (int i = 0; i < samples; ++i) {
+        const auto index = static_cast<uint32_t>(i * instances / samples);
+        const int pid = manager.status(index).pid;
+        const auto killed = Clock::now();
+        kill(pid, SIGKILL);
+        result.events += pump(loop, manager, [&] { return manager.status(index).state != InstanceState::RUNNING; });
+        reaps.push_back(micros(Clock::now() - killed));
+        result.events += pump(loop, manager, [&] {
+            const auto status = manager.status(index);
+            return status.state == InstanceState::RUNNING && status.pid != pid;
+        });
+    }
+    if (options.flood > 0) {
+        // let the log pipes run for a second; the deadline only wakes the loop
+        const auto until = Clock::now() + std::chrono::seconds(1);
+        loop.schedule(until, make_token(Source::TIMER, 1));
+        result.events += pump(loop, manager, [&] { return Clock::now() >= until; });
+    }
+
+    const auto stopping = Clock::now();
+    manager.shutdown(loop, 5000);
+    result.events += pump(loop, manager, [&] { return manager.active_count() == 0; });
+    result.shutdown_ms = micros(Clock::now() - stopping) / 1000;
+    result.allocations = g_allocations - allocations_before;
+
+    std::ranges::sort(reaps);
+    if (!reaps.empty()) {
+        result.reap_p50_us = reaps[reaps.size() / 2];
+        result.reap_p99_us = reaps[reaps.size() * 99 / 100];
+        result.reap_max_us = reaps.back();
+    }
+    if (result.events > 0) {
+        result.cpu_us_per_event = (cpu_us() - cpu_before) / static_cast<double>(result.events);
+    }
+    return true;
+}
+
+bool parse(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--fake" && i + 1 < argc) {
+            options.fake = argv[++i];
+        } else if (arg == "--mode" && i + 1 < argc) {
+            options.mode = argv[++i];
+        } else if (arg == "--flood" && i + 1 < argc) {
+            options.flood = std::atol(argv[++i]);
+        } else if (const int count = std::atoi(argv[i]); count > 0) {
+            options.counts.push_back(count);
+        } else {
+            return false;
+        }
+    }
+    if (options.counts.empty()) options.counts = {1, 10, 100, 1000};
+    if (options.fake.empty()) {
+        // built next to us by the same xmake invocation
+        options.fake = (std::filesystem::absolute(argv[0]).parent_path() / "fake-frpc").string();
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        std::fprintf(stderr, "usage: bench [--fake PATH] [--mode MODE] [--flood BYTES_PER_SEC] [COUNT...]\n");
+        return 2;
+    }
+
+    // a pidfd, a pipe and a log file per instance
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    char dir_template[] = "/tmp/multi-frp-bench.XXXXXX";
+    if (!mkdtemp(dir_template)) return 1;
+    const std::filesystem::path dir = dir_template;
+
+    // keep the report on stdout, silence the supervisor's own messages
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (FILE *null = std::freopen("/dev/null", "w", stdout); !null || !report) return 1;
+
+    std::fprintf(report, "fake-frpc: %s, mode: %s, flood: %ld B/s\n", options.fake.c_str(), options.mode.c_str(),
+                 options.flood);
+    std::fprintf(report, "%9s %10s %10s %10s %10s %12s %9s %12s %8s %7s\n", "instances", "start_ms", "reap_p50",
+                 "reap_p99", "reap_max", "shutdown_ms", "rss_kb", "cpu_us/event", "events", "allocs");
+    int status = 0;
+    for (const int count : options.counts) {
+        Result result;
+        if (!run(options, dir, count, result)) {
+            std::fprintf(report, "%9d failed to start, is fake-frpc at %s?\n", count, options.fake.c_str());
+            status = 1;
+            break;
+        }
+        std::fprintf(report, "%9d %10.2f %8.0fus %8.0fus %8.0fus %12.2f %9ld %12.2f %8zu %7zu\n", result.instances,
+                     result.start_ms, result.reap_p50_us, result.reap_p99_us, result.reap_max_us,
+                     result.shutdown_ms, result.rss_kb, result.cpu_us_per_event, result.events, result.allocations);
+        std::fflush(report);
+        if (result.allocations > 0) {
+            std::fprintf(report, "%9d instances: reaping, restarting or logging allocated %zu time(s)\n", count, result.allocations);
+            status = 1;
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    return status;
+}
@@ -0,0 +1,249 @@
+// supervise-alloc: runs the real App::supervise() loop against fake-frpc
+// instances and fails when the supervisor allocates in steady state.
+//
+//   supervise-alloc [--fake PATH]
+//
+// The supervisor runs on its own thread, with its output going to /dev/null,
+// while this one drives it from outside. The instances log through
+// multi-frp into rotating files, a TCP health probe checks each of them
+// every 100 ms against a socket this thread accepts on, and the metrics
+// and status files are rewritten at the same pace. Once all of them are
+// up, every heap allocation made on the supervisor thread is counted. During
+// that window children are killed and restarted, and `list` and `metrics`
+// are asked for over the control socket. Then SIGTERM shuts the supervisor
+// down. A count above zero fails the test and shows where the first
+// allocation came from.
+//
+// Steady state is what repeats while nobody touches the supervisor. Startup
+// and administrative paths are left out on purpose and may allocate:
+// loading the config, reload, upgrade and its handovers, reexec, the
+// start/stop/restart/tail commands, trace dumps, and error replies. The
+// first `list` and `metrics` replies also grow their reused buffers once,
+// so they run before counting starts.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "app.h"
+#include "util/unique_fd.hpp"
+
+namespace {
+
+std::atomic<bool> g_armed = false;
+thread_local bool t_supervisor = false;
+size_t g_allocations = 0; // only the supervisor thread counts
+void *g_first[32];
+int g_first_depth = 0;
+
+} // namespace
+
+void *operator new(size_t size) {
+    if (t_supervisor && g_armed.load(std::memory_order_relaxed)) {
+        if (g_allocations++ == 0) g_first_depth = backtrace(g_first, 32);
+    }
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr int k_instances = 4;
+constexpr int k_rounds = 8;
+
+// one request over the control socket, the whole reply
+std::string control(const std::string &path, std::string_view request) {
+    UniqueFd fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (!fd || connect(fd.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) return {};
+    if (write(fd.get(), request.data(), request.size()) != static_cast<ssize_t>(request.size())) return {};
+    std::string reply;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(fd.get(), buffer, sizeof(buffer))) > 0) reply.append(buffer, static_cast<size_t>(got));
+    return reply;
+}
+
+// pids of the RUNNING instances from a `list` reply
+std::vector<int> running_pids(const std::string &list) {
+    std::vector<int> pids;
+    std::istringstream lines(list);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string name, state;
+        int pid = 0;
+        if (fields >> name >> state >> pid && state == "running") pids.push_back(pid);
+    }
+    return pids;
+}
+
+// keep accepting the health probes until `done`
+void serve_probes(int listener, const std::atomic<bool> &done) {
+    while (!done) {
+        pollfd ready{.fd = listener, .events = POLLIN, .revents = 0};
+        if (poll(&ready, 1, 50) > 0) UniqueFd(accept4(listener, nullptr, nullptr, SOCK_CLOEXEC));
+    }
+}
+
+template <typename Predicate>
+bool wait_for(const std::string &socket, Predicate &&predicate, std::chrono::milliseconds timeout) {
+    const auto until = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < until) {
+        if (predicate(running_pids(control(socket, "list\n")))) return true;
+        std::this_thread::sleep_for(20ms);
+    }
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string fake;
+    if (argc == 3 && std::string_view(argv[1]) == "--fake") {
+        fake = argv[2];
+    } else if (argc == 1) {
+        // built next to us by the same xmake invocation
+        fake = (std::filesystem::absolute(argv[0]).parent_path() / "fake-frpc").string();
+    } else {
+        std::fprintf(stderr, "usage: supervise-alloc [--fake PATH]\n");
+        return 2;
+    }
+
+    char dir_template[] = "/tmp/multi-frp-alloc.XXXXXX";
+    if (!mkdtemp(dir_template)) return 1;
+    const std::filesystem::path dir = dir_template;
+    const auto socket_path = (dir / "control.sock").string();
+
+    UniqueFd listener(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    if (!listener || bind(listener.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener.get(), 64) != 0 ||
+        getsockname(listener.get(), reinterpret_cast<sockaddr *>(&address), &address_size) != 0) {
+        return 1;
+    }
+    const auto probe = "127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+
+    {
+        std::ofstream toml(dir / "fake.toml");
+        toml << "mode = \"run\"\nflood_bytes_per_sec = 4096\n";
+        std::ofstream json(dir / "config.json");
+        json << "{\n  \"frpc\": \"" << fake << "\",\n  \"configs\": [],\n  \"instances\": [\n";
+        for (int i = 0; i < k_instances; ++i) {
+            const auto config = dir / ("fake-" + std::to_string(i) + ".toml");
+            std::filesystem::copy_file(dir / "fake.toml", config);
+            json << "    { \"config\": \"" << config.string() << "\", \"health\": { \"tcp\": \"" << probe
+                 << "\", \"interval_ms\": 100, \"timeout_ms\": 100, \"failures\": 1000 } }"
+                 << (i + 1 < k_instances ? ",\n" : "\n");
+        }
+        json << "  ],\n"
+             << "  \"restart\": { \"mode\": \"always\", \"initial_backoff_ms\": 0, \"jitter\": 0, \"max_restarts\": 1000 },\n"
+             << "  \"log\": { \"dir\": \"" << (dir / "logs").string() << "\", \"max_size_kb\": 4, \"max_files\": 2 },\n"
+             << "  \"control_socket\": \"" << socket_path << "\",\n"
+             << "  \"metrics\": { \"file\": \"" << (dir / "metrics.prom").string() << "\", \"interval_ms\": 100 },\n"
+             << "  \"status_file\": \"" << (dir / "status").string() << "\"\n"
+             << "}\n";
+    }
+
+    // keep the report on stdout, silence the supervisor's own messages
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (FILE *null = std::freopen("/dev/null", "w", stdout); !null || !report) return 1;
+
+    // every thread has to leave SIGTERM to the supervisor's signalfd
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (const int sig : {SIGINT, SIGTERM, SIGCHLD, SIGUSR1, SIGHUP, SIGUSR2}) sigaddset(&signals, sig);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    // backtrace() loads its unwinder on the first call, not in the window
+    g_first_depth = backtrace(g_first, 32);
+    g_first_depth = 0;
+
+    std::atomic<bool> done = false;
+    std::thread prober(serve_probes, listener.get(), std::cref(done));
+    const auto config_path = (dir / "config.json").string();
+    int app_status = -1;
+    std::thread supervisor([&] {
+        t_supervisor = true;
+        std::string arg0 = "multi-frp", arg1 = "-c", arg2 = config_path;
+        char *args[] = {arg0.data(), arg1.data(), arg2.data(), nullptr};
+        App app;
+        app_status = app.run(3, args);
+    });
+
+    const auto all_running = [](const std::vector<int> &pids) { return pids.size() == k_instances; };
+    bool ok = wait_for(socket_path, all_running, 10s);
+    if (ok) {
+        // let the logins, probes and first rotations happen, then grow the
+        // reply buffers once
+        std::this_thread::sleep_for(500ms);
+        control(socket_path, "list\n");
+        control(socket_path, "metrics\n");
+        g_armed = true;
+
+        for (int round = 0; ok && round < k_rounds; ++round) {
+            const auto pids = running_pids(control(socket_path, "list\n"));
+            ok = pids.size() == k_instances && !control(socket_path, "metrics\n").empty();
+            if (!ok) break;
+            const int victim = pids[static_cast<size_t>(round) % pids.size()];
+            kill(victim, SIGKILL);
+            ok = wait_for(socket_path, [&](const std::vector<int> &now) {
+                return all_running(now) && std::ranges::find(now, victim) == now.end();
+            }, 5s);
+            std::this_thread::sleep_for(150ms);
+        }
+        g_armed = false;
+    }
+
+    kill(getpid(), SIGTERM);
+    supervisor.join();
+    done = true;
+    prober.join();
+    std::filesystem::remove_all(dir);
+
+    if (!ok) {
+        std::fprintf(report, "the instances did not come up or back, is fake-frpc at %s?\n", fake.c_str());
+        return 1;
+    }
+    std::fprintf(report, "supervisor exited with %d, %d restarts, %zu allocation(s) in steady state\n", app_status,
+                 k_rounds, g_allocations);
+    if (g_allocations > 0) {
+        std::fprintf(report, "first allocation from:\n");
+        std::fflush(report);
+        backtrace_symbols_fd(g_first, g_first_depth, fileno(report));
+        return 1;
+    }
+    return app_status == 0 ? 0 : 1;
+}
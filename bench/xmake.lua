@@ -0,0 +1,19 @@
+-- `xmake build bench && xmake run bench`, needs fake-frpc next to it
+target("bench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench.cpp")
+    add_includedirs("$(projectdir)/src")
+    add_deps("process", "fake-frpc")
+
+-- `xmake test`: the whole supervisor must not allocate in steady state
+if is_os("linux") then
+    target("supervise-alloc")
+        set_kind("binary")
+        add_options("version")
+        add_files("supervise_alloc.cpp", "$(projectdir)/src/*.cpp|main.cpp")
+        add_includedirs("$(projectdir)/src")
+        add_packages("daw_json_link")
+        add_deps("process", "fake-frpc")
+        add_tests("default")
+end
@@ -1,19 +1,59 @@
 #include "app.h"
-#include <array>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <ranges>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "util/print.hpp"
 
 #include "cli_parser.h"
 #include "config.hpp"
+#include "config_glob.h"
+#include "config_template.h"
+#include "process/trace.h"
 
 #ifndef _WIN32
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "control.h"
+#include "util/unique_fd.hpp"
 
 namespace {
 
+void append_status(std::string &out, const InstanceStatus &status) {
+    const auto field = [&](std::string_view text) {
+        out += text;
+        out += ' ';
+    };
+    field(status.name);
+    field(status.stopping ? "stopping" : state_name(status.state));
+    field(NumStr(status.pid));
+    field(NumStr(status.uptime_ms / 1000));
+    field(NumStr(status.restarts));
+    if (status.last_signal != 0) {
+        out += "SIG";
+        out += NumStr(status.last_signal);
+    } else {
+        out += NumStr(status.last_exit_code);
+    }
+    out += '\n';
+}
+
 sigset_t make_sigset(std::initializer_list<int> signals) {
     sigset_t sigset;
     sigemptyset(&sigset);
@@ -29,12 +69,11 @@ const char *signal_to_str(int signal) {
         case SIGTERM: return "SIGTERM";
         case SIGABRT: return "SIGABRT";
         case SIGSEGV: return "SIGSEGV";
+        case SIGHUP: return "SIGHUP";
         default: return "UNKNOWN SIGNAL";
     }
 }
 
-#define arg_end ((const char *) (nullptr))
-
 } // namespace
 
 #else
@@ -60,35 +99,328 @@ BOOL WINAPI console_ctrl_handler(DWORD signal) {
 
 } // namespace
 
-#define arg_end
-
 #endif
 
-int App::run(int argc, char *argv[]) {
+namespace {
+
+// Field-wise merge of the restart settings: the instance's own object wins,
+// then the top-level "restart" object, then the RestartPolicy defaults.
+// Returns nullopt when the resulting mode string is not recognized.
+std::optional<RestartPolicy> resolve_restart(const std::optional<RestartConfig> &own,
+                                             const std::optional<RestartConfig> &shared) {
+    const auto pick = [&](auto member, auto &out) {
+        if (own && ((*own).*member)) {
+            out = *((*own).*member);
+        } else if (shared && ((*shared).*member)) {
+            out = *((*shared).*member);
+        }
+    };
+
+    RestartPolicy policy;
+    pick(&RestartConfig::initial_backoff_ms, policy.initial_backoff_ms);
+    pick(&RestartConfig::max_backoff_ms, policy.max_backoff_ms);
+    pick(&RestartConfig::jitter, policy.jitter);
+    pick(&RestartConfig::max_restarts, policy.max_restarts);
+    int window_s = policy.window_ms / 1000;
+    pick(&RestartConfig::window_s, window_s);
+    policy.window_ms = window_s * 1000;
+    policy.jitter = std::clamp(policy.jitter, 0.0, 1.0);
+
+    std::string_view mode = "on-failure";
+    pick(&RestartConfig::mode, mode);
+    if (mode == "always") {
+        policy.mode = RestartMode::ALWAYS;
+    } else if (mode == "on-failure") {
+        policy.mode = RestartMode::ON_FAILURE;
+    } else if (mode == "never") {
+        policy.mode = RestartMode::NEVER;
+    } else {
+        return std::nullopt;
+    }
+    return policy;
+}
+
 #ifndef _WIN32
-    const auto signals = make_sigset({SIGINT, SIGTERM, SIGABRT, SIGSEGV});
-    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
-#else
-    if (!SetConsoleCtrlHandler(console_ctrl_handler, TRUE)) {
-        print("Error: Could not set control handler\n");
-        return 1;
+// Same merge as resolve_restart(); nullopt when neither object is given.
+std::optional<CgroupLimits> resolve_cgroup(const std::optional<CgroupConfig> &own,
+                                           const std::optional<CgroupConfig> &shared) {
+    if (!own && !shared) return std::nullopt;
+    const auto pick = [&](auto member) {
+        if (own && ((*own).*member)) return *((*own).*member);
+        if (shared && ((*shared).*member)) return *((*shared).*member);
+        return 0;
+    };
+
+    CgroupLimits limits;
+    limits.memory_max = int64_t{pick(&CgroupConfig::memory_max_mb)} * 1024 * 1024;
+    limits.cpu_weight = std::clamp(pick(&CgroupConfig::cpu_weight), 0, 10000);
+    limits.pids_max = pick(&CgroupConfig::pids_max);
+    return limits;
+}
+
+// "0-3,8" into `set`, false if it is malformed or empty
+bool parse_cpu_list(std::string_view list, cpu_set_t &set) {
+    CPU_ZERO(&set);
+    while (!list.empty()) {
+        const auto comma = list.find(',');
+        const auto item = list.substr(0, comma);
+        const auto dash = item.find('-');
+        const auto first_text = item.substr(0, dash);
+        const auto last_text = dash == std::string_view::npos ? first_text : item.substr(dash + 1);
+        int first = -1, last = -1;
+        std::from_chars(first_text.data(), first_text.data() + first_text.size(), first);
+        std::from_chars(last_text.data(), last_text.data() + last_text.size(), last);
+        if (first < 0 || first > last || last >= CPU_SETSIZE) return false;
+        for (int cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return CPU_COUNT(&set) > 0;
+}
+
+// Same merge as resolve_restart(). "cpus": "auto" only sets `spread`, the
+// cores are handed out by spread_cpus() once every instance is known.
+bool resolve_sched(const std::optional<SchedConfig> &own, const std::optional<SchedConfig> &shared,
+                   SchedOptions &sched, bool &spread) {
+    const auto pick = [&]<typename T>(std::optional<T> SchedConfig::*member) -> std::optional<T> {
+        if (own && (*own).*member) return (*own).*member;
+        if (shared) return (*shared).*member;
+        return std::nullopt;
+    };
+
+    spread = false;
+    if (const auto cpus = pick(&SchedConfig::cpus)) {
+        if (*cpus == "auto") {
+            spread = true;
+        } else if (parse_cpu_list(*cpus, sched.cpus)) {
+            sched.pin = true;
+        } else {
+            return false;
+        }
+    }
+    sched.numa_node = pick(&SchedConfig::numa_node).value_or(-1);
+    if (const auto nice = pick(&SchedConfig::nice)) {
+        sched.renice = true;
+        sched.nice = std::clamp(*nice, -20, 19);
+    }
+    if (const auto io_class = pick(&SchedConfig::io_class)) {
+        if (*io_class == "realtime") {
+            sched.io_class = 1;
+        } else if (*io_class == "best-effort") {
+            sched.io_class = 2;
+        } else if (*io_class == "idle") {
+            sched.io_class = 3;
+        } else {
+            return false;
+        }
+        sched.io_level = std::clamp(pick(&SchedConfig::io_level).value_or(4), 0, 7);
+    }
+    if (const auto policy = pick(&SchedConfig::policy)) {
+        if (*policy == "batch") {
+            sched.policy = SCHED_BATCH;
+        } else if (*policy == "idle") {
+            sched.policy = SCHED_IDLE;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int parse_signal(std::string_view name) {
+    constexpr std::pair<std::string_view, int> k_signals[] = {
+        {"SIGHUP", SIGHUP}, {"SIGINT", SIGINT},   {"SIGQUIT", SIGQUIT}, {"SIGTERM", SIGTERM},
+        {"SIGKILL", SIGKILL}, {"SIGUSR1", SIGUSR1}, {"SIGUSR2", SIGUSR2},
+    };
+    const auto it = std::ranges::find(k_signals, name, &std::pair<std::string_view, int>::first);
+    return it == std::end(k_signals) ? 0 : it->second;
+}
+
+// Same merge as resolve_restart(), except for debounce_ms which only counts
+// at the top level. `rule` stays empty without settings or with "none".
+bool resolve_network(const std::optional<NetworkConfig> &own, const std::optional<NetworkConfig> &shared,
+                     std::optional<NetworkWatcher::Rule> &rule) {
+    const auto pick = [&]<typename T>(std::optional<T> NetworkConfig::*member) -> std::optional<T> {
+        if (own && (*own).*member) return (*own).*member;
+        if (shared) return (*shared).*member;
+        return std::nullopt;
+    };
+
+    rule.reset();
+    if (!own && !shared) return true;
+    const auto action = pick(&NetworkConfig::action).value_or("restart");
+    if (action == "none") return true;
+
+    NetworkWatcher::Rule resolved;
+    if (const auto on = pick(&NetworkConfig::on)) {
+        resolved.changes = 0;
+        for (const auto &change : *on) {
+            if (change == "link") {
+                resolved.changes |= NetworkWatcher::LINK;
+            } else if (change == "address") {
+                resolved.changes |= NetworkWatcher::ADDRESS;
+            } else if (change == "route") {
+                resolved.changes |= NetworkWatcher::ROUTE;
+            } else {
+                return false;
+            }
+        }
+    }
+    resolved.interfaces = pick(&NetworkConfig::interfaces).value_or(std::vector<std::string>{});
+    if (action == "signal") {
+        resolved.signal = parse_signal(pick(&NetworkConfig::signal).value_or(""));
+        if (resolved.signal == 0) return false;
+    } else if (action != "restart") {
+        return false;
+    }
+    rule = std::move(resolved);
+    return true;
+}
+
+// Same merge as resolve_restart(), except for interval_ms which only counts
+// at the top level. `limits` stays empty when nothing is limited; negative
+// values are rejected.
+bool resolve_limits(const std::optional<LimitsConfig> &own, const std::optional<LimitsConfig> &shared,
+                    std::optional<ResourceLimits> &limits) {
+    const auto pick = [&](std::optional<int> LimitsConfig::*member, int fallback) {
+        if (own && (*own).*member) return *((*own).*member);
+        if (shared && (*shared).*member) return *((*shared).*member);
+        return fallback;
+    };
+
+    limits.reset();
+    if (!own && !shared) return true;
+    ResourceLimits resolved;
+    const int rss_mb = pick(&LimitsConfig::rss_mb, 0);
+    resolved.rss_bytes = int64_t{rss_mb} << 20;
+    resolved.cpu_percent = pick(&LimitsConfig::cpu_percent, 0);
+    resolved.cpu_window_ms = pick(&LimitsConfig::cpu_window_s, resolved.cpu_window_ms / 1000) * 1000;
+    resolved.fds = pick(&LimitsConfig::fds, 0);
+    resolved.threads = pick(&LimitsConfig::threads, 0);
+    resolved.samples = pick(&LimitsConfig::samples, resolved.samples);
+    resolved.cooldown_ms = pick(&LimitsConfig::cooldown_s, resolved.cooldown_ms / 1000) * 1000;
+    if (rss_mb < 0 || resolved.cpu_percent < 0 || resolved.cpu_window_ms <= 0 || resolved.fds < 0 ||
+        resolved.threads < 0 || resolved.samples < 1 || resolved.cooldown_ms < 0) {
+        return false;
     }
+    if (resolved.rss_bytes == 0 && resolved.cpu_percent == 0 && resolved.fds == 0 && resolved.threads == 0) {
+        return true;
+    }
+    limits = resolved;
+    return true;
+}
+
+LaunchPolicy launch_policy(const Config &config) {
+    LaunchPolicy policy;
+    if (!config.launch) return policy;
+    const auto &launch = *config.launch;
+    policy.max_starting = std::max(launch.max_starting.value_or(0), 0);
+    policy.settle_ms = std::max(launch.settle_ms.value_or(policy.settle_ms), 0);
+    policy.stagger_ms = std::max(launch.stagger_ms.value_or(0), 0);
+    policy.server_rate = std::max(launch.server_rate.value_or(0.0), 0.0);
+    policy.server_burst = std::max(launch.server_burst.value_or(policy.server_burst), 1);
+    return policy;
+}
+
+// "host:port" of the frps an frpc config logs in to, from its serverAddr and
+// serverPort (server_addr/server_port in the legacy ini format). Only used
+// to group launches, so a config without them maps to "".
+std::string frps_server(std::istream &file) {
+    const auto trim = [](std::string_view text) {
+        const auto first = text.find_first_not_of(" \t\"',");
+        if (first == std::string_view::npos) return std::string_view{};
+        return text.substr(first, text.find_last_not_of(" \t\"',\r") - first + 1);
+    };
+
+    std::string line;
+    std::string host;
+    std::string port = "7000";
+    while (std::getline(file, line)) {
+        const std::string_view text = line;
+        const auto separator = text.find_first_of("=:");
+        if (separator == std::string_view::npos) continue;
+        const auto key = trim(text.substr(0, separator));
+        if (key == "serverAddr" || key == "server_addr") {
+            host = trim(text.substr(separator + 1));
+        } else if (key == "serverPort" || key == "server_port") {
+            port = trim(text.substr(separator + 1));
+        }
+    }
+    return host.empty() ? std::string{} : host + ":" + port;
+}
+
+// the rendered configs the running instances use, by instance name
+using RenderedByName = std::unordered_map<std::string_view, std::shared_ptr<const RenderedConfig>>;
+
+RenderedByName running_rendered(const ProcessManager &manager) {
+    RenderedByName rendered;
+    for (uint32_t i = 0; i < manager.size(); ++i) {
+        if (manager.rendered(i)) rendered.emplace(manager.status(i).name, manager.rendered(i));
+    }
+    return rendered;
+}
+
+// A rendered config in a sealed memfd: frpc can read it through
+// k_config_fd_path, nobody can change it underneath the instance.
+std::shared_ptr<const RenderedConfig> seal_config(const std::string &name, std::string_view text) {
+    auto rendered = std::make_shared<RenderedConfig>();
+    rendered->fd.reset(memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!rendered->fd) return nullptr;
+    for (size_t written = 0; written < text.size();) {
+        const auto got = write(rendered->fd.get(), text.data() + written, text.size() - written);
+        if (got <= 0) return nullptr;
+        written += static_cast<size_t>(got);
+    }
+    if (fcntl(rendered->fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        return nullptr;
+    }
+    rendered->hash = std::hash<std::string_view>{}(text);
+    return rendered;
+}
 #endif
 
-    CliParser parser;
-    const auto parse_result = parser.parse(argc, argv);
-    if (parse_result == ParseResult::GRACEFUL_EXIT) {
-        return 0;
-    } else if (parse_result == ParseResult::ERR) {
-        return 1;
+// Instance names default to the config file's stem; when two plain
+// `configs` entries share a stem, the full path is used instead.
+std::vector<std::string> instance_names(const std::vector<InstanceConfig> &instances) {
+    std::vector<std::string> names;
+    names.reserve(instances.size());
+    std::unordered_map<std::string_view, int> uses;
+    uses.reserve(instances.size());
+    for (const auto &instance : instances) {
+        names.push_back(instance.name ? *instance.name : std::filesystem::path(instance.config).stem().string());
+    }
+    for (const auto &name : names) {
+        uses[name] += 1;
+    }
+    // decided before any rename, the keys view into `names`
+    std::vector<bool> clashes(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        clashes[i] = !instances[i].name && uses[names[i]] > 1;
     }
+    for (size_t i = 0; i < instances.size(); ++i) {
+        if (clashes[i]) names[i] = instances[i].config;
+    }
+    return names;
+}
 
-    const auto &config_file_path = parser.config_file_path;
-    const auto config_file_path_str = config_file_path.string();
+struct InstanceSpec {
+    std::string name;
+    std::string config;
+    std::vector<std::string> args;
+    InstanceOptions options;
+#ifndef _WIN32
+    std::optional<HealthCheck> health;
+    std::optional<NetworkWatcher::Rule> network;
+    std::optional<ResourceLimits> limits;
+#endif
+};
 
-    if (!std::filesystem::exists(config_file_path)) {
-        print("Config file does not exist: ", config_file_path_str, "\n");
-        return 1;
+std::optional<Config> load_config(const std::filesystem::path &path) {
+    const auto path_str = path.string();
+    if (!std::filesystem::exists(path)) {
+        print("Config file does not exist: ", path_str, "\n");
+        return std::nullopt;
     }
 
     // Read the JSON configuration file
@@ -96,20 +428,20 @@ int App::run(int argc, char *argv[]) {
     std::string file_content;
     {
         const auto file_deleter = [](FILE *file) static { if (file) {fclose(file);} };
-        std::unique_ptr<FILE, decltype(file_deleter)> file_ptr(fopen(config_file_path_str.c_str(), "r"), file_deleter);
+        std::unique_ptr<FILE, decltype(file_deleter)> file_ptr(fopen(path_str.c_str(), "r"), file_deleter);
         if (!file_ptr) {
-            print("Failed to open config file: ", config_file_path_str, "\n");
-            return 1;
+            print("Failed to open config file: ", path_str, "\n");
+            return std::nullopt;
         }
 
-        const auto file_size = std::filesystem::file_size(config_file_path);
+        const auto file_size = std::filesystem::file_size(path);
         file_content.resize(file_size);
 
         fread(file_content.data(), 1, file_content.size(), file_ptr.get());
     }
 
     /// Parse JSON
-    Config config;
+    std::optional<Config> config;
     try {
         using namespace daw::json::options;
 
@@ -117,50 +449,939 @@ int App::run(int argc, char *argv[]) {
                                               parse_flags<PolicyCommentTypes::cpp>);
     } catch (const daw::json::json_exception &e) {
         print("Error parsing config file: ", e.what(), "\n");
-        return 1;
     } catch (const std::exception &e) {
         print("Error parsing config file: ", e.what(), "\n");
-        return 1;
     } catch (...) {
         print("Unknown error parsing config file.\n");
-        return 1;
+    }
+    if (!config) return std::nullopt;
+
+    // directories and patterns in `configs` become one entry per file
+    auto paths = expand_configs(config->configs);
+    if (!paths) return std::nullopt;
+    config->configs = std::move(*paths);
+    return config;
+}
+
+#ifndef _WIN32
+// "cpus": "auto": one core each, round robin over the cores we may use.
+// Interactive instances are handed cores from the front of the list and
+// batch/idle ones from the back, so bulk tunnels land on other cores than
+// latency sensitive ones whenever there are enough of them.
+void spread_cpus(std::vector<InstanceSpec> &specs, const std::vector<size_t> &indices) {
+    if (indices.empty()) return;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    std::vector<int> cores;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) cores.push_back(cpu);
+    }
+    if (cores.empty()) return;
+
+    size_t front = 0, back = 0;
+    for (const auto index : indices) {
+        auto &sched = specs[index].options.sched;
+        const bool bulk = sched.policy == SCHED_BATCH || sched.policy == SCHED_IDLE;
+        const int core = bulk ? cores[cores.size() - 1 - back++ % cores.size()] : cores[front++ % cores.size()];
+        CPU_ZERO(&sched.cpus);
+        CPU_SET(core, &sched.cpus);
+        sched.pin = true;
+    }
+}
+#endif
+
+// Validate the config and turn it into everything needed to launch its
+// instances. Nothing is started here, so a bad reload can be rejected
+// before it touches the running set.
+// With `running`, a rendered config that came out the same reuses the memfd
+// its instance already has, so a reload only seals what changed.
+std::optional<std::vector<InstanceSpec>> build_specs(const Config &config,
+                                                     [[maybe_unused]] const ProcessManager *running = nullptr) {
+    auto instances = config.all_instances();
+    // the configs of templated instances, appended after the others
+    std::vector<std::string> texts;
+    if (config.templates) {
+#ifdef _WIN32
+        print("Error: templates are not supported on windows\n");
+        return std::nullopt;
+#else
+        auto rendered = render_templates(*config.templates);
+        if (!rendered) return std::nullopt;
+        instances.reserve(instances.size() + rendered->size());
+        texts.reserve(rendered->size());
+        for (auto &[instance, text] : *rendered) {
+            instances.push_back(std::move(instance));
+            texts.push_back(std::move(text));
+        }
+#endif
+    }
+    const auto first_rendered = instances.size() - texts.size();
+    const auto names = instance_names(instances);
+    std::unordered_set<std::string_view> seen;
+    seen.reserve(names.size());
+    for (const auto &name : names) {
+        if (!seen.insert(name).second) {
+            print("Duplicate instance name: ", name, "\n");
+            return std::nullopt;
+        }
     }
 
-    // Check if all config files exist
-    for (const auto &config_file : config.configs) {
-        const auto config_path = std::filesystem::path(config_file);
-        if (!std::filesystem::exists(config_path)) {
-            print("Config file does not exist: ", config_file, "\n");
-            return 1;
+    // `configs` entries were checked while expanding them, template bases
+    // while rendering
+    for (const auto &instance : instances | std::views::take(first_rendered) | std::views::drop(config.configs.size())) {
+        if (!std::filesystem::exists(std::filesystem::path(instance.config))) {
+            print("Config file does not exist: ", instance.config, "\n");
+            return std::nullopt;
+        }
+    }
+
+#ifndef _WIN32
+    if (config.log) {
+        std::error_code ec;
+        std::filesystem::create_directories(config.log->dir, ec);
+        if (ec) {
+            print("Failed to create log directory: ", config.log->dir, "\n");
+            return std::nullopt;
+        }
+    }
+#endif
+
+    // Resolve the frpc binary once instead of a PATH search on every spawn
+    const auto frpc = find_executable(config.frpc);
+#ifndef _WIN32
+    const auto sealed = running && !texts.empty() ? running_rendered(*running) : RenderedByName{};
+#endif
+
+    std::vector<InstanceSpec> specs(instances.size());
+#ifndef _WIN32
+    std::vector<size_t> spread_indices;
+#endif
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const auto &instance = instances[i];
+        auto &spec = specs[i];
+        if (const auto policy = resolve_restart(instance.restart, config.restart)) {
+            spec.options.restart = *policy;
+        } else {
+            print("Invalid restart mode for config: ", instance.config, "\n");
+            return std::nullopt;
+        }
+#ifndef _WIN32
+        if (config.log) {
+            auto &log = spec.options.log;
+            log.path = (std::filesystem::path(config.log->dir) / (names[i] + ".log")).string();
+            log.max_size = int64_t{config.log->max_size_kb.value_or(10240)} * 1024;
+            log.max_files = config.log->max_files.value_or(5);
+            log.ring_size = static_cast<size_t>(std::max(config.log->recent_output_kb.value_or(16), 0)) * 1024;
+        }
+#endif
+#ifndef _WIN32
+        if (i >= first_rendered) {
+            const auto &text = texts[i - first_rendered];
+            std::istringstream rendered(text);
+            spec.options.server = frps_server(rendered);
+            if (const auto found = sealed.find(names[i]);
+                found != sealed.end() && found->second->hash == std::hash<std::string_view>{}(text)) {
+                spec.options.rendered = found->second;
+            } else {
+                spec.options.rendered = seal_config(names[i], text);
+            }
+            if (!spec.options.rendered) {
+                print("Failed to create a sealed memfd for instance: ", names[i], "\n");
+                return std::nullopt;
+            }
+        } else {
+            std::ifstream file(instance.config);
+            spec.options.server = frps_server(file);
+        }
+        // the most direct signal available: frpc's own log line, else its probe
+        if (config.log) {
+            spec.options.ready_from = ReadySource::OUTPUT;
+        } else if (instance.health) {
+            spec.options.ready_from = ReadySource::PROBE;
         }
+        spec.options.cgroup = resolve_cgroup(instance.cgroup, config.cgroup);
+        bool spread = false;
+        if (!resolve_sched(instance.sched, config.sched, spec.options.sched, spread)) {
+            print("Invalid sched settings for config: ", instance.config, "\n");
+            return std::nullopt;
+        }
+        if (spread) spread_indices.push_back(i);
+        if (const auto &health = instance.health) {
+            HealthCheck check;
+            check.interval_ms = std::max(health->interval_ms.value_or(check.interval_ms), 100);
+            check.timeout_ms = std::clamp(health->timeout_ms.value_or(check.timeout_ms), 10, check.interval_ms);
+            check.failures = std::max(health->failures.value_or(check.failures), 1);
+            const auto &target = health->http ? health->http : health->tcp;
+            if (!target || (health->http && health->tcp) || !resolve_address(*target, check)) {
+                print("Invalid health probe for config: ", instance.config, "\n");
+                return std::nullopt;
+            }
+            if (health->http) {
+                check.kind = HealthCheck::Kind::HTTP;
+                const auto credentials = health->user ? *health->user + ":" + health->password.value_or("") : "";
+                check.request = make_http_request(*target, health->path.value_or("/api/status"), credentials);
+            }
+            spec.health = std::move(check);
+        }
+        if (!resolve_network(instance.network, config.network, spec.network)) {
+            print("Invalid network settings for config: ", instance.config, "\n");
+            return std::nullopt;
+        }
+        if (spec.network) spec.network->instance = names[i];
+        if (!resolve_limits(instance.limits, config.limits, spec.limits)) {
+            print("Invalid limits for config: ", instance.config, "\n");
+            return std::nullopt;
+        }
+#endif
+        spec.name = names[i];
+        spec.config = instance.config;
+#ifndef _WIN32
+        spec.args = {frpc, "-c", spec.options.rendered ? k_config_fd_path : instance.config};
+#else
+        spec.args = {frpc, "-c", instance.config};
+#endif
+    }
+#ifndef _WIN32
+    spread_cpus(specs, spread_indices);
+#endif
+    return specs;
+}
+
+#ifndef _WIN32
+std::vector<ConfigWatcher::File> watched_files(const Config &config, const std::vector<InstanceSpec> &specs) {
+    std::vector<ConfigWatcher::File> files;
+    if (!config.watch_configs.value_or(false)) return files;
+    files.reserve(specs.size());
+    for (const auto &spec : specs) {
+        // a template's base is only read again by a reload
+        if (!spec.options.rendered) files.push_back({spec.name, spec.config});
+    }
+    return files;
+}
+
+bool wants_cgroups(const std::vector<InstanceSpec> &specs) {
+    return std::ranges::any_of(specs, [](const InstanceSpec &spec) { return spec.options.cgroup.has_value(); });
+}
+
+std::vector<HealthChecker::Target> health_targets(const std::vector<InstanceSpec> &specs) {
+    std::vector<HealthChecker::Target> targets;
+    for (const auto &spec : specs) {
+        if (spec.health) targets.push_back({spec.name, *spec.health});
+    }
+    return targets;
+}
+
+std::vector<NetworkWatcher::Rule> network_rules(const std::vector<InstanceSpec> &specs) {
+    std::vector<NetworkWatcher::Rule> rules;
+    for (const auto &spec : specs) {
+        if (spec.network) rules.push_back(*spec.network);
+    }
+    return rules;
+}
+
+int network_debounce(const Config &config) {
+    return config.network ? config.network->debounce_ms.value_or(2000) : 2000;
+}
+
+std::vector<ResourceWatchdog::Target> limit_targets(const std::vector<InstanceSpec> &specs) {
+    std::vector<ResourceWatchdog::Target> targets;
+    for (const auto &spec : specs) {
+        if (spec.limits) targets.push_back({spec.name, *spec.limits});
+    }
+    return targets;
+}
+
+HandoverPolicy handover_policy(const Config &config) {
+    HandoverPolicy policy;
+    if (config.upgrade) {
+        policy.ready_timeout_ms = std::max(config.upgrade->ready_timeout_ms.value_or(policy.ready_timeout_ms), 100);
+        policy.settle_ms = std::max(config.upgrade->settle_ms.value_or(policy.settle_ms), 0);
+    }
+    policy.stop_timeout_ms = config.shutdown_timeout();
+    return policy;
+}
+
+int limits_interval(const Config &config) {
+    const int interval = config.limits ? config.limits->interval_ms.value_or(10000) : 10000;
+    return std::max(interval, 100);
+}
+
+// Descriptors the supervisor keeps open for `specs`: per instance its pidfd,
+// the output pipe and log file, the cgroup directory with its stat files,
+// the /proc files of the usage sampler, a health probe's socket and the
+// memfd of a rendered config. The base covers stdio, the event loop,
+// signalfd, inotify, the control socket with its connections, the notify
+// socket, and files opened in passing.
+size_t fd_budget(const Config &config, const std::vector<InstanceSpec> &specs) {
+    constexpr size_t k_base = 64;
+    size_t needed = k_base;
+    for (const auto &spec : specs) {
+        needed += 1;
+        if (config.log) needed += 3;
+        if (spec.options.cgroup) needed += 3;
+        if (config.metrics || spec.limits) needed += 3;
+        if (spec.health) needed += 1;
+        if (spec.options.rendered) needed += 1;
+    }
+    return needed;
+}
+
+// Raise the soft RLIMIT_NOFILE to `needed` if the hard limit allows it, so
+// thousands of instances do not run into EMFILE halfway through a start.
+bool fit_fd_budget(size_t needed, size_t instances) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return true;
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur >= needed) return true;
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed) {
+        print("Error: ", NumStr(static_cast<long long>(instances)), " instance(s) need about ",
+              NumStr(static_cast<long long>(needed)), " file descriptors, RLIMIT_NOFILE allows ",
+              NumStr(static_cast<long long>(limit.rlim_max)), " (raise LimitNOFILE= or ulimit -Hn)\n");
+        return false;
+    }
+    const auto previous = limit.rlim_cur;
+    limit.rlim_cur = needed;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0) return true;
+    print("Raised the open file limit from ", NumStr(static_cast<long long>(previous)), " to ",
+          NumStr(static_cast<long long>(needed)), "\n");
+    return true;
+}
+
+// descriptor of the memfd a re-exec hands its process table over in
+constexpr const char *k_state_env = "MULTI_FRP_STATE";
+
+// path of our own binary, read at startup: once a package update replaced
+// it, /proc/self/exe points at the deleted old file
+std::string self_executable() {
+    char path[4096];
+    const auto size = readlink("/proc/self/exe", path, sizeof(path));
+    if (size <= 0 || static_cast<size_t>(size) >= sizeof(path)) return {};
+    std::string_view self(path, static_cast<size_t>(size));
+    if (self.ends_with(" (deleted)")) self.remove_suffix(std::string_view(" (deleted)").size());
+    return std::string(self);
+}
+#endif
+
+} // namespace
+
+int App::run(int argc, char *argv[]) {
+#ifndef _WIN32
+    // SIGCHLD is only consumed when the kernel has no pidfd_open,
+    // SIGUSR1 dumps the recent output kept for each instance,
+    // SIGHUP reloads the config file, SIGUSR2 writes the trace file
+    const auto signals = make_sigset({SIGINT, SIGTERM, SIGABRT, SIGSEGV, SIGCHLD, SIGUSR1, SIGHUP, SIGUSR2});
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    argv_ = argv;
+    self_path_ = self_executable();
+#else
+    if (!SetConsoleCtrlHandler(console_ctrl_handler, TRUE)) {
+        print("Error: Could not set control handler\n");
+        return 1;
     }
+#endif
+
+    CliParser parser;
+    const auto parse_result = parser.parse(argc, argv);
+    if (parse_result == ParseResult::GRACEFUL_EXIT) {
+        return 0;
+    } else if (parse_result == ParseResult::ERR) {
+        return 1;
+    }
+
+    if (!parser.control_socket.empty()) {
+#ifndef _WIN32
+        return control_request(parser.control_socket, parser.control_request);
+#else
+        print("Error: --control is not supported on windows\n");
+        return 1;
+#endif
+    }
+
+    const auto loading = TraceRing::Clock::now();
+    auto config = load_config(parser.config_file_path);
+    if (!config) return 1;
+    const auto specs = build_specs(*config);
+    if (!specs) return 1;
+    // sized by the config, so its own parse is recorded after the fact
+    tracer().allocate(config->trace_events());
+    tracer().record_span(TraceKind::CONFIG, {}, loading, TraceRing::Clock::now());
 
     // Print the frpc binary path and config files
-    print("frpc binary: ", config.frpc, "\n");
+    print("frpc binary: ", specs->empty() ? config->frpc : specs->front().args.front(), "\n");
     print("Config files:\n");
-    for (const auto &config_file : config.configs) {
-        print(" - ", config_file, "\n");
+    for (const auto &spec : *specs) {
+#ifndef _WIN32
+        if (spec.options.rendered) {
+            print(" - ", spec.config, ", rendered (", spec.name, ")\n");
+            continue;
+        }
+#endif
+        print(" - ", spec.config, " (", spec.name, ")\n");
     }
 
+#ifndef _WIN32
+    if (!fit_fd_budget(fd_budget(*config, *specs), specs->size())) return 1;
+    // before any spawn, so the children do not inherit $NOTIFY_SOCKET
+    notifier_.open();
+    if (wants_cgroups(*specs)) process_manager_.enable_cgroups();
+    process_manager_.set_launch_policy(launch_policy(*config));
+#endif
+
     // Execute multiple frpc all at background
-    for (const auto &config_file : config.configs) {
-        const auto args = std::array{config.frpc.c_str(), "-c", config_file.c_str(), arg_end};
-        if (!process_manager_.add_process(args)) {
-            print("Failed to start frpc with config: ", config_file, "\n");
-            return 1;
+    process_manager_.reserve(specs->size());
+    for (const auto &spec : *specs) {
+        process_manager_.add_process(spec.name, spec.args, spec.options);
+    }
+#ifndef _WIN32
+    // started by a re-exec: the children are still running, take them over
+    if (const char *state = std::getenv(k_state_env)) {
+        int fd = -1;
+        std::from_chars(state, state + std::strlen(state), fd);
+        unsetenv(k_state_env);
+        if (fd >= 0) {
+            process_manager_.restore_state(fd, resumed_dropped_);
+            close(fd);
         }
-        print("Started frpc with config: ", config_file, "\n");
+    }
+#endif
+    if (!process_manager_.start_all()) {
+        process_manager_.terminate_all(config->shutdown_timeout());
+        return 1;
     }
 
 #ifndef _WIN32
-    int last_signal;
-    sigwait(&signals, &last_signal);
-    print("Received termination signal: ", signal_to_str(last_signal), "\n");
-    process_manager_.terminate_all();
+    config_path_ = parser.config_file_path;
+    config_ = std::move(*config);
+    watcher_.set_files(watched_files(config_, *specs));
+    health_.set_targets(health_targets(*specs));
+    network_.set_rules(network_rules(*specs), network_debounce(config_));
+    limits_.set_targets(limit_targets(*specs), limits_interval(config_));
+    apply_metrics_config();
+    status_.configure(config_.status_file.value_or(""));
+    if (!supervise(signals)) {
+        process_manager_.terminate_all(config_.shutdown_timeout());
+        return 1;
+    }
 #endif
 
     process_manager_.wait_all();
     print("All frpc instances have been executed.\n");
 
+#ifndef _WIN32
+    // the final states stay readable, marked as no longer live
+    status_.publish(process_manager_);
+    status_.close();
+#endif
+
+#ifndef _WIN32
+    write_trace();
+#else
+    if (config && config->trace && config->trace->file) tracer().write_file(*config->trace->file);
+#endif
+
+#ifndef _WIN32
+    if (const auto parked = process_manager_.parked_count(); parked > 0) {
+        print(NumStr(static_cast<long long>(parked)), " frpc instance(s) were parked after crash looping.\n");
+        return 1;
+    }
+#endif
+
     return 0;
-}
\ No newline at end of file
+}
+
+#ifndef _WIN32
+
+bool App::supervise(const sigset_t &signals) {
+    const UniqueFd signal_fd(signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (!signal_fd) {
+        print("Error: Could not create signalfd\n");
+        return false;
+    }
+
+    EventLoop loop;
+    if (!loop.is_valid() || !loop.add(signal_fd.get(), make_token(Source::SIGNAL))) {
+        print("Error: Could not set up event loop\n");
+        return false;
+    }
+    process_manager_.watch(loop);
+    watcher_.attach(loop);
+    metrics_.attach(loop);
+    health_.attach(loop);
+    network_.attach(loop);
+    limits_.attach(loop);
+    notifier_.attach(loop);
+    // taken over from before a re-exec, but the config dropped them since
+    for (const auto &name : std::exchange(resumed_dropped_, {})) {
+        if (const int index = process_manager_.find(name); index >= 0) {
+            print("Instance ", name, " is no longer in the config, stopping it\n");
+            process_manager_.remove_instance(static_cast<uint32_t>(index), config_.shutdown_timeout());
+        }
+    }
+    supervise_started_ = EventLoop::Clock::now();
+    update_readiness();
+    status_.publish(process_manager_);
+
+    if (config_.control_socket && !control_.listen(*config_.control_socket, loop)) {
+        // after a re-exec the children are already running, keep them
+        // supervised even without the socket
+        if (!process_manager_.resumed()) return false;
+        print("Error: carrying on without a control socket\n");
+    }
+
+    // Only woken for signals, child exits and due timers; nothing is polled.
+    // Runs until every instance has stopped for good or was parked, or with
+    // a control socket, until a termination signal shut everything down.
+    const auto keep_running = [&] {
+        if (process_manager_.active_count() > 0) return true;
+        return control_.is_listening() && !process_manager_.shutting_down();
+    };
+    while (keep_running()) {
+        EventLoop::Event events[16];
+        const size_t count = loop.poll(events);
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto token = events[i].token;
+            switch (token_source(token)) {
+                case Source::SIGNAL: {
+                    signalfd_siginfo info;
+                    while (read(signal_fd.get(), &info, sizeof(info)) == sizeof(info)) {
+                        on_signal(static_cast<int>(info.ssi_signo), loop);
+                    }
+                    break;
+                }
+                case Source::CHILD: process_manager_.on_child_event(token_index(token)); break;
+                case Source::SHUTDOWN: process_manager_.kill_remaining(); break;
+                case Source::RESTART: process_manager_.on_restart_due(token_index(token)); break;
+                case Source::LOG: process_manager_.on_log_event(token_index(token)); break;
+                case Source::STOP_DEADLINE: process_manager_.on_stop_deadline(token_index(token)); break;
+                case Source::LAUNCH: process_manager_.on_launch_due(); break;
+                case Source::WATCHDOG: notifier_.on_due(); break;
+                case Source::CONTROL:
+                case Source::CONTROL_CLIENT:
+                    if (const auto request = control_.on_event(token, events[i].events)) {
+                        on_control(*request);
+                    }
+                    break;
+                case Source::WATCH: watcher_.on_event(); break;
+                case Source::METRICS: metrics_.on_due(process_manager_); break;
+                case Source::PROBE:
+                    if (const auto instance = health_.on_event(token_index(token), events[i].events, process_manager_)) {
+                        on_unhealthy(*instance);
+                    }
+                    break;
+                case Source::PROBE_DUE:
+                    if (const auto instance = health_.on_due(token_index(token), process_manager_)) {
+                        on_unhealthy(*instance);
+                    }
+                    break;
+                case Source::NETWORK: network_.on_event(); break;
+                case Source::NETWORK_DUE:
+                    for (const auto *rule : network_.on_due()) {
+                        on_network_change(*rule);
+                    }
+                    break;
+                case Source::HANDOVER: process_manager_.on_handover_event(token_index(token)); break;
+                case Source::HANDOVER_DUE: process_manager_.on_handover_due(token_index(token)); break;
+                case Source::HANDOVER_LOG: process_manager_.on_handover_log(token_index(token)); break;
+                case Source::LIMITS:
+                    for (const auto instance : limits_.on_due(process_manager_)) {
+                        on_over_limits(instance);
+                    }
+                    break;
+                case Source::WATCH_DUE:
+                    if (const auto instance = watcher_.on_due(token_index(token))) {
+                        on_config_changed(*instance);
+                    }
+                    break;
+                default: break;
+            }
+        }
+        if (upgrade_.poll(process_manager_) == RollingUpgrade::Outcome::DONE) config_.frpc = upgrade_.binary();
+        // between batches, so no exit is half handled when the table is saved
+        if (!reexec_binary_.empty()) reexec();
+        update_readiness();
+        status_.publish(process_manager_);
+    }
+
+    return true;
+}
+
+void App::on_control(const ControlServer::Request &request) {
+    const auto &command = request.command;
+    // kept between requests, a `list` or `metrics` poll reuses its capacity
+    auto &reply = reply_;
+    reply.clear();
+
+    if (command == "list") {
+        reply = "ok\nNAME STATE PID UPTIME_S RESTARTS LAST_EXIT\n";
+        for (uint32_t i = 0; i < process_manager_.size(); ++i) {
+            const auto status = process_manager_.status(i);
+            if (status.state != InstanceState::REMOVED) append_status(reply, status);
+        }
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    if (command == "metrics") {
+        if (!metrics_.enabled()) {
+            control_.respond(request.slot, "error: metrics are not configured\n");
+            return;
+        }
+        reply = "ok\n";
+        metrics_.render(process_manager_, reply);
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    if (command == "trace") {
+        if (!tracer().enabled()) {
+            control_.respond(request.slot, "error: tracing is turned off\n");
+            return;
+        }
+        reply = "ok\n";
+        tracer().write_json(reply);
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    if (command == "reload") {
+        std::string summary;
+        const bool done = reload(summary);
+        reply = done ? "ok\n" : "error: reload failed, see the supervisor's output\n";
+        reply += summary;
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    if (command == "upgrade") {
+        // without an argument, to the binary the config file names now
+        std::string binary(request.argument);
+        if (binary.empty()) {
+            const auto config = load_config(config_path_);
+            if (!config) {
+                control_.respond(request.slot, "error: the config file could not be loaded\n");
+                return;
+            }
+            binary = config->frpc;
+        }
+        binary = find_executable(binary);
+        if (access(binary.c_str(), X_OK) != 0) {
+            control_.respond(request.slot, "error: " + binary + " is not executable\n");
+            return;
+        }
+        std::string error;
+        const int batch = config_.upgrade ? config_.upgrade->batch.value_or(1) : 1;
+        if (!upgrade_.begin(process_manager_, binary, batch, handover_policy(config_), error)) {
+            control_.respond(request.slot, "error: " + error + "\n");
+            return;
+        }
+        reply = "ok\nupgrading to ";
+        reply += binary;
+        reply += ", progress is in the supervisor's output\n";
+        if (!request.argument.empty()) {
+            reply += "set \"frpc\" in the config file as well, or a reload moves the instances back\n";
+        }
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    if (command == "reexec") {
+        // without an argument, the binary at the path we were started from
+        const auto binary = request.argument.empty() ? self_path_ : find_executable(request.argument);
+        std::string error;
+        if (binary.empty() || access(binary.c_str(), X_OK) != 0) {
+            error = binary.empty() ? "the path of the multi-frp binary is unknown" : binary + " is not executable";
+        } else if (upgrade_.active()) {
+            error = "an upgrade is running: ";
+            upgrade_.describe(error);
+        } else if (const auto config = load_config(config_path_); !config || !build_specs(*config, &process_manager_)) {
+            // the new image would fail the same way and leave the children unsupervised
+            error = "the config file could not be loaded";
+        } else {
+            process_manager_.can_hand_off(error);
+        }
+        if (!error.empty()) {
+            control_.respond(request.slot, "error: " + error + "\n");
+            return;
+        }
+        reexec_binary_ = binary;
+        control_.respond(request.slot, "ok\nre-executing " + binary + ", the frpc instances keep running\n");
+        return;
+    }
+
+    if (command != "start" && command != "stop" && command != "restart" && command != "tail") {
+        control_.respond(request.slot, "error: unknown command\n");
+        return;
+    }
+
+    const int index = process_manager_.find(request.argument);
+    if (index < 0) {
+        reply = "error: no instance named '";
+        reply += request.argument;
+        reply += "'\n";
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    const auto slot = static_cast<uint32_t>(index);
+    if (command == "tail") {
+        const auto [older, newer] = process_manager_.recent_output(slot);
+        reply = "ok\n";
+        reply += older;
+        reply += newer;
+        control_.respond(request.slot, reply);
+        return;
+    }
+
+    bool done;
+    if (command == "start") {
+        done = process_manager_.start_instance(slot);
+    } else if (command == "stop") {
+        done = process_manager_.stop_instance(slot, config_.shutdown_timeout());
+    } else {
+        done = process_manager_.restart_instance(slot, config_.shutdown_timeout());
+    }
+    control_.respond(request.slot, done ? "ok\n" : "error: not applicable in the instance's current state\n");
+}
+
+void App::on_signal(int signal, EventLoop &loop) {
+    switch (signal) {
+        case SIGCHLD: process_manager_.on_sigchld(); break;
+        case SIGUSR1: process_manager_.dump_output(); break;
+        case SIGUSR2:
+            if (!config_.trace || !config_.trace->file) {
+                print("Received signal: SIGUSR2, but no trace file is configured\n");
+            } else {
+                write_trace();
+            }
+            break;
+        case SIGHUP: {
+            print("Received signal: SIGHUP, reloading config\n");
+            std::string summary;
+            reload(summary);
+            break;
+        }
+        default:
+            print("Received termination signal: ", signal_to_str(signal), "\n");
+            if (!process_manager_.shutting_down()) {
+                notifier_.send("STOPPING=1");
+                process_manager_.shutdown(loop, config_.shutdown_timeout());
+            } else {
+                // a second request means the user is done waiting
+                process_manager_.kill_remaining();
+            }
+            break;
+    }
+}
+
+void App::apply_metrics_config() {
+    if (!config_.metrics) {
+        metrics_.configure({}, 0);
+        return;
+    }
+    const auto &metrics = *config_.metrics;
+    metrics_.configure(metrics.file.value_or(""), std::max(metrics.interval_ms.value_or(1000), 100));
+}
+
+void App::update_readiness() {
+    using namespace std::chrono;
+    const size_t ready = process_manager_.ready_count();
+    if (ready == last_ready_) return;
+    last_ready_ = ready;
+
+    size_t total = 0;
+    for (uint32_t i = 0; i < process_manager_.size(); ++i) {
+        if (process_manager_.status(i).state != InstanceState::REMOVED) total += 1;
+    }
+    const auto quorum = std::min(static_cast<size_t>(std::max(config_.ready_quorum.value_or(0), 0)), total);
+    const auto needed = quorum > 0 ? quorum : total;
+    const NumStr ready_text(static_cast<long long>(ready));
+    const NumStr total_text(static_cast<long long>(total));
+    notifier_.send("STATUS=", ready_text, "/", total_text, " frpc instance(s) ready");
+
+    if (ready_notified_ || ready < needed) return;
+    ready_notified_ = true;
+    notifier_.send("READY=1");
+    const auto elapsed = duration_cast<milliseconds>(EventLoop::Clock::now() - supervise_started_);
+    print(ready_text, "/", total_text, " frpc instance(s) ready after ", NumStr(elapsed.count()), " ms\n");
+}
+
+void App::on_config_changed(std::string_view instance) {
+    const int index = process_manager_.find(instance);
+    if (index < 0) return;
+    const auto slot = static_cast<uint32_t>(index);
+    // stopped, parked and backing off instances read the new file on their
+    // next start anyway
+    const auto status = process_manager_.status(slot);
+    if (status.state != InstanceState::RUNNING || status.stopping) return;
+    print("Config of ", instance, " changed, restarting it\n");
+    process_manager_.restart_instance(slot, config_.shutdown_timeout());
+}
+
+void App::on_network_change(const NetworkWatcher::Rule &rule) {
+    const int index = process_manager_.find(rule.instance);
+    if (index < 0) return;
+    const auto slot = static_cast<uint32_t>(index);
+    // whatever is not running picks the new network up when it starts
+    const auto status = process_manager_.status(slot);
+    if (status.state != InstanceState::RUNNING || status.stopping) return;
+    if (rule.signal != 0) {
+        if (process_manager_.signal_instance(slot, rule.signal)) {
+            print("Network changed, sent signal ", NumStr(rule.signal), " to ", rule.instance, "\n");
+        }
+        return;
+    }
+    print("Network changed, restarting ", rule.instance, "\n");
+    process_manager_.restart_instance(slot, config_.shutdown_timeout());
+}
+
+void App::on_over_limits(std::string_view instance) {
+    const int index = process_manager_.find(instance);
+    if (index < 0) return;
+    process_manager_.restart_instance(static_cast<uint32_t>(index), config_.shutdown_timeout());
+}
+
+void App::on_unhealthy(std::string_view instance) {
+    const int index = process_manager_.find(instance);
+    if (index < 0) return;
+    print("Process ", instance, " is unhealthy, restarting it\n");
+    process_manager_.restart_instance(static_cast<uint32_t>(index), config_.shutdown_timeout());
+}
+
+bool App::reload(std::string &summary) {
+    using namespace std::chrono;
+    const auto begin = steady_clock::now();
+    if (process_manager_.shutting_down()) {
+        summary = "shutting down\n";
+        return false;
+    }
+    if (upgrade_.active()) {
+        summary = "an upgrade is running: ";
+        upgrade_.describe(summary);
+        summary += '\n';
+        return false;
+    }
+
+    auto config = load_config(config_path_);
+    const auto specs = config ? build_specs(*config, &process_manager_) : std::nullopt;
+    if (!specs) {
+        print("Reload aborted, the running instances are left unchanged\n");
+        return false;
+    }
+
+    if (!fit_fd_budget(fd_budget(*config, *specs), specs->size())) {
+        print("Reload aborted, the running instances are left unchanged\n");
+        return false;
+    }
+
+    const int timeout = config->shutdown_timeout();
+    if (wants_cgroups(*specs)) process_manager_.enable_cgroups();
+    process_manager_.set_launch_policy(launch_policy(*config));
+    std::unordered_map<std::string_view, const InstanceSpec *> wanted;
+    wanted.reserve(specs->size());
+    for (const auto &spec : *specs) {
+        wanted.emplace(spec.name, &spec);
+    }
+
+    // Matched by name: instances that are in both sets are only touched when
+    // their command line changed, new ones are added after the walk since
+    // adding may grow the table.
+    size_t removed = 0, restarted = 0, unchanged = 0;
+    for (uint32_t i = 0; i < process_manager_.size(); ++i) {
+        const auto status = process_manager_.status(i);
+        if (status.state == InstanceState::REMOVED) continue;
+        const auto it = wanted.find(status.name);
+        if (it == wanted.end()) {
+            process_manager_.remove_instance(i, timeout);
+            removed += 1;
+            continue;
+        }
+        const auto &spec = *it->second;
+        if (process_manager_.reconfigure(i, spec.args, spec.options, timeout)) {
+            restarted += 1;
+        } else {
+            unchanged += 1;
+        }
+        wanted.erase(it);
+    }
+
+    // what is left in `wanted` is new; walk `specs` to keep the file's order
+    size_t added = 0;
+    process_manager_.reserve(process_manager_.size() + wanted.size());
+    for (const auto &spec : *specs) {
+        if (!wanted.contains(spec.name)) continue;
+        const auto index = process_manager_.add_process(spec.name, spec.args, spec.options);
+        process_manager_.start_instance(index);
+        added += 1;
+    }
+
+    watcher_.set_files(watched_files(*config, *specs));
+    health_.set_targets(health_targets(*specs));
+    network_.set_rules(network_rules(*specs), network_debounce(*config));
+    limits_.set_targets(limit_targets(*specs), limits_interval(*config));
+    if (config->control_socket != config_.control_socket) {
+        print("control_socket changes take effect after a restart of multi-frp\n");
+    }
+    config_ = std::move(*config);
+    apply_metrics_config();
+    status_.configure(config_.status_file.value_or(""));
+
+    const auto end = steady_clock::now();
+    tracer().record_span(TraceKind::RELOAD, {}, begin, end);
+    const auto elapsed = duration_cast<microseconds>(end - begin);
+    summary = "reloaded in ";
+    summary += NumStr(elapsed.count());
+    summary += " us: ";
+    summary += NumStr(static_cast<long long>(added));
+    summary += " added, ";
+    summary += NumStr(static_cast<long long>(removed));
+    summary += " removed, ";
+    summary += NumStr(static_cast<long long>(restarted));
+    summary += " restarted, ";
+    summary += NumStr(static_cast<long long>(unchanged));
+    summary += " unchanged\n";
+    print("Config ", summary);
+    return true;
+}
+
+void App::reexec() {
+    const auto binary = std::exchange(reexec_binary_, {});
+    std::string error;
+    const UniqueFd state(memfd_create("multi-frp-state", MFD_CLOEXEC));
+    if (!state) {
+        error = "could not create a memfd";
+    } else if (process_manager_.save_state(state.get(), error)) {
+        print("Re-executing ", binary, ", ", NumStr(static_cast<long long>(process_manager_.active_count())),
+              " frpc instance(s) are handed over\n");
+        write_trace();
+        notifier_.send("RELOADING=1");
+        notifier_.export_env(true);
+        setenv(k_state_env, std::to_string(state.get()).c_str(), 1);
+        fcntl(state.get(), F_SETFD, 0);
+        // the "ok" to the reexec request may still be queued
+        control_.finish(1000);
+        std::fflush(stdout);
+        execv(binary.c_str(), argv_);
+
+        // still here: nothing was replaced, carry on supervising
+        error = "execv: ";
+        error += std::strerror(errno);
+        fcntl(state.get(), F_SETFD, FD_CLOEXEC);
+        unsetenv(k_state_env);
+        notifier_.export_env(false);
+        if (ready_notified_) notifier_.send("READY=1");
+        process_manager_.cancel_handoff();
+    }
+    print("Re-exec of ", binary, " failed (", error, "), carrying on\n");
+}
+
+void App::write_trace() const {
+    if (!config_.trace || !config_.trace->file || !tracer().enabled()) return;
+    const auto &path = *config_.trace->file;
+    if (tracer().write_file(path)) {
+        print("Trace written to ", path, "\n");
+    } else {
+        print("Error: Could not write trace file ", path, "\n");
+    }
+}
+
+#endif
@@ -1,10 +1,75 @@
 #pragma once
 
+#include <filesystem>
+#include <string>
+
+#include "config.hpp"
 #include "process/process_manager.h"
 
+#ifndef _WIN32
+#include <signal.h>
+
+#include "config_watcher.h"
+#include "control.h"
+#include "health.h"
+#include "metrics.h"
+#include "net_watcher.h"
+#include "notify.h"
+#include "resource_watchdog.h"
+#include "status_table.h"
+#include "upgrade.h"
+#endif
+
 struct App final {
     int run(int argc, char *argv[]);
 
 private:
+#ifndef _WIN32
+    // Event-driven core loop: returns once every child has exited, either
+    // on its own or through the parallel shutdown a termination signal starts.
+    bool supervise(const sigset_t &signals);
+    void on_signal(int signal, EventLoop &loop);
+    void on_control(const ControlServer::Request &request);
+    // Re-read the config file and apply only the difference to the running
+    // instances (SIGHUP or the `reload` control command). On any error the
+    // running set is left alone. `summary` gets a one-line report.
+    bool reload(std::string &summary);
+    void on_config_changed(std::string_view instance);
+    void on_unhealthy(std::string_view instance);
+    void on_network_change(const NetworkWatcher::Rule &rule);
+    void on_over_limits(std::string_view instance);
+    void apply_metrics_config();
+    // READY=1 once the quorum of instances is ready, STATUS= on every change
+    void update_readiness();
+    // dump the trace ring to `trace.file`, if one is configured
+    void write_trace() const;
+    // Hand the process table over to `reexec_binary_` through a memfd and
+    // execve it (the `reexec` control command); the children keep running.
+    // Only returns when that failed, with everything left as it was.
+    void reexec();
+#endif
+
     ProcessManager process_manager_;
+#ifndef _WIN32
+    ControlServer control_;
+    ConfigWatcher watcher_;
+    MetricsExporter metrics_;
+    HealthChecker health_;
+    NetworkWatcher network_;
+    ResourceWatchdog limits_;
+    RollingUpgrade upgrade_;
+    Notifier notifier_;
+    StatusTable status_;
+    bool ready_notified_ = false;
+    size_t last_ready_ = static_cast<size_t>(-1);
+    EventLoop::Clock::time_point supervise_started_{};
+    std::filesystem::path config_path_;
+    Config config_; // the config currently applied
+    char **argv_ = nullptr;
+    std::string self_path_; // our own binary as of startup
+    std::string reexec_binary_; // re-exec requested, done after the event batch
+    std::string reply_; // the control reply being built
+    // taken over from before a re-exec but no longer in the config
+    std::vector<std::string> resumed_dropped_;
+#endif
 };
\ No newline at end of file
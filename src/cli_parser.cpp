@@ -10,13 +10,17 @@ namespace {
 void print_usage() {
     // clang-format off
     print(
-        "Usage: {} [--help] [--version] --config CONFIG_FILE\n"
+        "Usage: ", program_name, " [--help] [--version] --config CONFIG_FILE\n"
+        "       ", program_name, " --control SOCKET COMMAND [INSTANCE]\n"
         "\n"
         "Optional arguments:\n"
         "  -h, --help                shows this help message and exits\n"
         "  -v, --version             prints version information and exits\n"
-        "  -c, --config CONFIG_FILE  Path to the JSON configuration file [required]\n",
-        program_name
+        "  -c, --config CONFIG_FILE  Path to the JSON configuration file [required]\n"
+        "  --control SOCKET          Send COMMAND to the multi-frp listening on SOCKET:\n"
+        "                              list, tail INSTANCE, start INSTANCE,\n"
+        "                              stop INSTANCE, restart INSTANCE, reload, metrics, trace,\n"
+        "                              upgrade [FRPC], reexec [BINARY]\n"
     );
     // clang-format on
 }
@@ -47,6 +51,22 @@ ParseResult CliParser::parse(this CliParser &self, int argc, char *argv[]) {
     for (size_t i = 0; i < normalized.size(); ++i) {
         const auto arg = normalized[i];
 
+        if (std::strcmp(arg, "--control") == 0) {
+            if (i + 2 >= normalized.size()) {
+                print("Error parsing arguments: --control requires SOCKET and COMMAND.\n");
+                print_usage();
+                return ParseResult::ERR;
+            }
+
+            self.control_socket = normalized[i + 1];
+            // the rest of the command line is the request
+            for (size_t j = i + 2; j < normalized.size(); ++j) {
+                if (!self.control_request.empty()) self.control_request += ' ';
+                self.control_request += normalized[j];
+            }
+            return ParseResult::SUCCESS;
+        }
+
         if (std::strcmp(arg, "-c") == 0 || std::strcmp(arg, "--config") == 0) {
             if (i + 1 >= normalized.size() || normalized[i + 1][0] == 0) {
                 print("Error parsing arguments: -c/--config requires CONFIG_FILE.\n");
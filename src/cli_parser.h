@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
 
 enum class ParseResult : unsigned char {
     SUCCESS,
@@ -12,4 +13,9 @@ struct CliParser final {
     ParseResult parse(this CliParser &self, int argc, char *argv[]);
 
     std::filesystem::path config_file_path;
+
+    // --control mode: send `control_request` to a running multi-frp instead
+    // of starting one
+    std::string control_socket;
+    std::string control_request;
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -11,23 +13,456 @@
     "frpc": "path/to/frpc",
     "configs": [
         "path/to/config1.toml",
-        "path/to/config2.toml"
-    ]
+        "path/to/config2.toml",
+        "path/to/conf.d"
+    ],
+    "shutdown_timeout_ms": 5000,
+    "restart": {
+        "mode": "on-failure",
+        "initial_backoff_ms": 1000,
+        "max_backoff_ms": 60000,
+        "jitter": 0.2,
+        "max_restarts": 5,
+        "window_s": 60
+    },
+    "instances": [
+        { "config": "path/to/config3.toml", "name": "game", "restart": { "mode": "always" } },
+        {
+            "config": "path/to/config4.toml",
+            "health": { "http": "127.0.0.1:7400", "user": "admin", "password": "admin",
+                        "interval_ms": 10000, "timeout_ms": 2000, "failures": 3 }
+        }
+    ],
+    "templates": [
+        {
+            "base": "path/to/base.toml",
+            "name": "${site}-${set}",
+            "matrix": [
+                { "vars": ["site", "server", "token"],
+                  "rows": [["hk", "hk.example.com", "s3cret"], ["fra", "fra.example.com", "t0ken"]] },
+                { "vars": ["set", "admin_port"], "rows": [["web", "7401"], ["ssh", "7402"]] }
+            ],
+            "health": { "http": "127.0.0.1:${admin_port}" }
+        }
+    ],
+    "log": {
+        "dir": "path/to/logs",
+        "max_size_kb": 10240,
+        "max_files": 5,
+        "recent_output_kb": 16
+    },
+    "control_socket": "/run/multi-frp.sock",
+    "watch_configs": true,
+    "metrics": {
+        "file": "/var/lib/node_exporter/multi-frp.prom",
+        "interval_ms": 1000
+    },
+    "cgroup": {
+        "memory_max_mb": 256,
+        "cpu_weight": 100,
+        "pids_max": 64
+    },
+    "sched": {
+        "cpus": "auto",
+        "numa_node": 0,
+        "nice": 0,
+        "io_class": "best-effort",
+        "io_level": 4,
+        "policy": "batch"
+    },
+    "launch": {
+        "max_starting": 4,
+        "settle_ms": 3000,
+        "stagger_ms": 250,
+        "server_rate": 2,
+        "server_burst": 4
+    },
+    "ready_quorum": 2,
+    "trace": {
+        "events": 4096,
+        "file": "/var/log/multi-frp/trace.json"
+    },
+    "status_file": "/run/multi-frp.status",
+    "network": {
+        "on": ["address", "route"],
+        "interfaces": ["wwan0", "eth0"],
+        "action": "restart",
+        "debounce_ms": 2000
+    },
+    "limits": {
+        "rss_mb": 512,
+        "cpu_percent": 90,
+        "cpu_window_s": 300,
+        "fds": 4096,
+        "threads": 256,
+        "samples": 3,
+        "cooldown_s": 600,
+        "interval_ms": 10000
+    },
+    "upgrade": {
+        "batch": 1,
+        "ready_timeout_ms": 60000,
+        "settle_ms": 5000
+    }
 }
 */
 
+// every field is optional; missing ones fall back to the top-level "restart"
+// object and then to the defaults of RestartPolicy
+struct RestartConfig final {
+    std::optional<std::string> mode; // "always" | "on-failure" | "never"
+    std::optional<int> initial_backoff_ms;
+    std::optional<int> max_backoff_ms;
+    std::optional<double> jitter;
+    std::optional<int> max_restarts;
+    std::optional<int> window_s;
+};
+
+// put each instance into its own cgroup v2 with these limits; fields merge
+// like RestartConfig, unset ones leave the kernel default (no limit)
+struct CgroupConfig final {
+    std::optional<int> memory_max_mb;
+    std::optional<int> cpu_weight;
+    std::optional<int> pids_max;
+};
+
+// CPU placement and priorities of an instance's frpc; fields merge like
+// RestartConfig, unset ones inherit the supervisor's
+struct SchedConfig final {
+    std::optional<std::string> cpus; // "0-3,8", or "auto" to spread instances over the cores
+    std::optional<int> numa_node;    // preferred memory node
+    std::optional<int> nice;
+    std::optional<std::string> io_class; // "realtime" | "best-effort" | "idle"
+    std::optional<int> io_level;         // 0..7
+    std::optional<std::string> policy;   // "batch" | "idle"
+};
+
+// pace spawns instead of starting everything back to back; instances are
+// grouped by the frps server their config logs in to
+struct LaunchConfig final {
+    std::optional<int> max_starting;
+    std::optional<int> settle_ms;
+    std::optional<int> stagger_ms;
+    std::optional<double> server_rate; // launches per second per server
+    std::optional<int> server_burst;
+};
+
+// lifecycle events kept in memory, dumped as Chrome trace JSON
+struct TraceConfig final {
+    std::optional<int> events; // ring size, 0 turns recording off
+    // written on SIGUSR2 and at exit
+    std::optional<std::string> file;
+};
+
+// capture each frpc's stdout/stderr into <dir>/<config name>.log
+struct LogConfig final {
+    std::string dir;
+    std::optional<int> max_size_kb;
+    std::optional<int> max_files;
+    // tail kept in memory per instance, dumped when it fails (0 disables)
+    std::optional<int> recent_output_kb;
+};
+
+// sample every child's resource usage, exposed in Prometheus text format
+// through the `metrics` control command and optionally a file
+struct MetricsConfig final {
+    std::optional<std::string> file;
+    std::optional<int> interval_ms;
+};
+
+// active health probe of an instance, either a TCP connect to `tcp` or a
+// GET of `path` on `http` (frpc's webServer) that has to answer 200
+struct HealthConfig final {
+    std::optional<std::string> tcp; // "host:port"
+    std::optional<std::string> http;
+    std::optional<std::string> path; // defaults to /api/status
+    std::optional<std::string> user;
+    std::optional<std::string> password;
+    std::optional<int> interval_ms;
+    std::optional<int> timeout_ms;
+    std::optional<int> failures; // consecutive failures before a restart
+};
+
+// restart (or signal) instances once the host's network changed, like an
+// uplink failing over; per instance, unset fields fall back to the top level
+struct NetworkConfig final {
+    std::optional<std::vector<std::string>> on; // "link", "address", "route"
+    std::optional<std::vector<std::string>> interfaces; // default: any
+    std::optional<std::string> action; // "restart" (default), "signal" or "none"
+    std::optional<std::string> signal; // sent by "signal", e.g. "SIGUSR1"
+    std::optional<int> debounce_ms; // top level only
+};
+
+// restart an instance whose frpc keeps using more than this, sampled from
+// /proc; per instance, unset fields fall back to the top level
+struct LimitsConfig final {
+    std::optional<int> rss_mb;
+    std::optional<int> cpu_percent; // of one core, averaged over cpu_window_s
+    std::optional<int> cpu_window_s;
+    std::optional<int> fds;
+    std::optional<int> threads;
+    std::optional<int> samples; // consecutive samples over a limit
+    std::optional<int> cooldown_s; // least time between two such restarts
+    std::optional<int> interval_ms; // top level only
+};
+
+// rolling upgrades of the frpc binary (the `upgrade` control command)
+struct UpgradeConfig final {
+    std::optional<int> batch; // instances moved at the same time
+    std::optional<int> ready_timeout_ms; // for the new binary to log in
+    // without a log to spot the login in, running this long counts as ready
+    std::optional<int> settle_ms;
+};
+
+// an frpc instance with its own settings, `configs` entries use the defaults
+struct InstanceConfig final {
+    std::string config;
+    // used by the control socket and for log file names, defaults to the
+    // config file's stem
+    std::optional<std::string> name;
+    std::optional<RestartConfig> restart;
+    std::optional<HealthConfig> health;
+    std::optional<CgroupConfig> cgroup;
+    std::optional<SchedConfig> sched;
+    std::optional<NetworkConfig> network;
+    std::optional<LimitsConfig> limits;
+};
+
+// one dimension of a template's matrix: every row gives a value to each of
+// `vars`, by position
+struct TemplateAxisConfig final {
+    std::vector<std::string> vars;
+    std::vector<std::vector<std::string>> rows;
+};
+
+// frpc configs generated in memory, see render_templates(): one instance per
+// combination of a row from every axis, `${var}` replaced in the `base`
+// file, in `name` and in the health probe's address and path
+struct TemplateConfig final {
+    std::string base;
+    std::string name; // has to come out different for every combination
+    std::vector<TemplateAxisConfig> matrix;
+    std::optional<RestartConfig> restart;
+    std::optional<HealthConfig> health;
+    std::optional<CgroupConfig> cgroup;
+    std::optional<SchedConfig> sched;
+    std::optional<NetworkConfig> network;
+    std::optional<LimitsConfig> limits;
+};
+
 struct Config final {
     std::string frpc;
+    // files, directories or `*`/`?` patterns, see expand_configs()
     std::vector<std::string> configs;
+    // shared deadline for all children to exit after SIGTERM before SIGKILL
+    std::optional<int> shutdown_timeout_ms;
+    std::optional<RestartConfig> restart;
+    std::optional<std::vector<InstanceConfig>> instances;
+    std::optional<std::vector<TemplateConfig>> templates;
+    std::optional<LogConfig> log;
+    std::optional<std::string> control_socket;
+    // restart an instance when the content of its frpc config changes
+    std::optional<bool> watch_configs;
+    std::optional<MetricsConfig> metrics;
+    std::optional<CgroupConfig> cgroup;
+    std::optional<SchedConfig> sched;
+    std::optional<LaunchConfig> launch;
+    // instances that have to be ready before systemd is told READY=1,
+    // defaults to all of them
+    std::optional<int> ready_quorum;
+    std::optional<TraceConfig> trace;
+    // memory-mapped status table for external monitors, see status_layout.h
+    std::optional<std::string> status_file;
+    std::optional<NetworkConfig> network;
+    std::optional<LimitsConfig> limits;
+    std::optional<UpgradeConfig> upgrade;
+
+    int shutdown_timeout() const { return shutdown_timeout_ms.value_or(5000); }
+    size_t trace_events() const {
+        const int events = trace && trace->events ? *trace->events : 4096;
+        return static_cast<size_t>(std::max(events, 0));
+    }
+
+    // `configs` and `instances` flattened into one list
+    std::vector<InstanceConfig> all_instances() const {
+        std::vector<InstanceConfig> result;
+        result.reserve(configs.size() + (instances ? instances->size() : 0));
+        for (const auto &config : configs) {
+            auto &instance = result.emplace_back();
+            instance.config = config;
+        }
+        if (instances) {
+            result.insert(result.end(), instances->begin(), instances->end());
+        }
+        return result;
+    }
 };
 
 namespace daw::json {
 
+template <>
+struct json_data_contract<RestartConfig> {
+    using type = json_member_list<
+        json_string_null<"mode", std::optional<std::string>>,
+        json_number_null<"initial_backoff_ms", std::optional<int>>,
+        json_number_null<"max_backoff_ms", std::optional<int>>,
+        json_number_null<"jitter", std::optional<double>>,
+        json_number_null<"max_restarts", std::optional<int>>,
+        json_number_null<"window_s", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<CgroupConfig> {
+    using type = json_member_list<
+        json_number_null<"memory_max_mb", std::optional<int>>,
+        json_number_null<"cpu_weight", std::optional<int>>,
+        json_number_null<"pids_max", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<SchedConfig> {
+    using type = json_member_list<
+        json_string_null<"cpus", std::optional<std::string>>,
+        json_number_null<"numa_node", std::optional<int>>,
+        json_number_null<"nice", std::optional<int>>,
+        json_string_null<"io_class", std::optional<std::string>>,
+        json_number_null<"io_level", std::optional<int>>,
+        json_string_null<"policy", std::optional<std::string>>>;
+};
+
+template <>
+struct json_data_contract<LogConfig> {
+    using type = json_member_list<
+        json_string<"dir">,
+        json_number_null<"max_size_kb", std::optional<int>>,
+        json_number_null<"max_files", std::optional<int>>,
+        json_number_null<"recent_output_kb", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<LaunchConfig> {
+    using type = json_member_list<
+        json_number_null<"max_starting", std::optional<int>>,
+        json_number_null<"settle_ms", std::optional<int>>,
+        json_number_null<"stagger_ms", std::optional<int>>,
+        json_number_null<"server_rate", std::optional<double>>,
+        json_number_null<"server_burst", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<TraceConfig> {
+    using type = json_member_list<
+        json_number_null<"events", std::optional<int>>,
+        json_string_null<"file", std::optional<std::string>>>;
+};
+
+template <>
+struct json_data_contract<MetricsConfig> {
+    using type = json_member_list<
+        json_string_null<"file", std::optional<std::string>>,
+        json_number_null<"interval_ms", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<HealthConfig> {
+    using type = json_member_list<
+        json_string_null<"tcp", std::optional<std::string>>,
+        json_string_null<"http", std::optional<std::string>>,
+        json_string_null<"path", std::optional<std::string>>,
+        json_string_null<"user", std::optional<std::string>>,
+        json_string_null<"password", std::optional<std::string>>,
+        json_number_null<"interval_ms", std::optional<int>>,
+        json_number_null<"timeout_ms", std::optional<int>>,
+        json_number_null<"failures", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<NetworkConfig> {
+    using type = json_member_list<
+        json_array_null<"on", std::string>,
+        json_array_null<"interfaces", std::string>,
+        json_string_null<"action", std::optional<std::string>>,
+        json_string_null<"signal", std::optional<std::string>>,
+        json_number_null<"debounce_ms", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<LimitsConfig> {
+    using type = json_member_list<
+        json_number_null<"rss_mb", std::optional<int>>,
+        json_number_null<"cpu_percent", std::optional<int>>,
+        json_number_null<"cpu_window_s", std::optional<int>>,
+        json_number_null<"fds", std::optional<int>>,
+        json_number_null<"threads", std::optional<int>>,
+        json_number_null<"samples", std::optional<int>>,
+        json_number_null<"cooldown_s", std::optional<int>>,
+        json_number_null<"interval_ms", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<UpgradeConfig> {
+    using type = json_member_list<
+        json_number_null<"batch", std::optional<int>>,
+        json_number_null<"ready_timeout_ms", std::optional<int>>,
+        json_number_null<"settle_ms", std::optional<int>>>;
+};
+
+template <>
+struct json_data_contract<InstanceConfig> {
+    using type = json_member_list<
+        json_string<"config">,
+        json_string_null<"name", std::optional<std::string>>,
+        json_class_null<"restart", std::optional<RestartConfig>>,
+        json_class_null<"health", std::optional<HealthConfig>>,
+        json_class_null<"cgroup", std::optional<CgroupConfig>>,
+        json_class_null<"sched", std::optional<SchedConfig>>,
+        json_class_null<"network", std::optional<NetworkConfig>>,
+        json_class_null<"limits", std::optional<LimitsConfig>>>;
+};
+
+template <>
+struct json_data_contract<TemplateAxisConfig> {
+    using type = json_member_list<
+        json_array<"vars", std::string>,
+        json_array<"rows", json_array_no_name<std::string>>>;
+};
+
+template <>
+struct json_data_contract<TemplateConfig> {
+    using type = json_member_list<
+        json_string<"base">,
+        json_string<"name">,
+        json_array<"matrix", TemplateAxisConfig>,
+        json_class_null<"restart", std::optional<RestartConfig>>,
+        json_class_null<"health", std::optional<HealthConfig>>,
+        json_class_null<"cgroup", std::optional<CgroupConfig>>,
+        json_class_null<"sched", std::optional<SchedConfig>>,
+        json_class_null<"network", std::optional<NetworkConfig>>,
+        json_class_null<"limits", std::optional<LimitsConfig>>>;
+};
+
 template <>
 struct json_data_contract<Config> {
     using type = json_member_list<
         json_string<"frpc">,
-        json_array<"configs", std::string>>;
+        json_array<"configs", std::string>,
+        json_number_null<"shutdown_timeout_ms", std::optional<int>>,
+        json_class_null<"restart", std::optional<RestartConfig>>,
+        json_array_null<"instances", InstanceConfig>,
+        json_array_null<"templates", TemplateConfig>,
+        json_class_null<"log", std::optional<LogConfig>>,
+        json_string_null<"control_socket", std::optional<std::string>>,
+        json_bool_null<"watch_configs", std::optional<bool>>,
+        json_class_null<"metrics", std::optional<MetricsConfig>>,
+        json_class_null<"cgroup", std::optional<CgroupConfig>>,
+        json_class_null<"sched", std::optional<SchedConfig>>,
+        json_class_null<"launch", std::optional<LaunchConfig>>,
+        json_number_null<"ready_quorum", std::optional<int>>,
+        json_class_null<"trace", std::optional<TraceConfig>>,
+        json_string_null<"status_file", std::optional<std::string>>,
+        json_class_null<"network", std::optional<NetworkConfig>>,
+        json_class_null<"limits", std::optional<LimitsConfig>>,
+        json_class_null<"upgrade", std::optional<UpgradeConfig>>>;
 };
 
 } // namespace daw::json
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "config_glob.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+
+#include "util/print.hpp"
+
+namespace {
+
+constexpr std::array<std::string_view, 5> k_extensions = {".toml", ".yaml", ".yml", ".json", ".ini"};
+
+bool has_wildcard(std::string_view text) {
+    return text.find_first_of("*?") != std::string_view::npos;
+}
+
+bool is_frpc_config(const std::filesystem::path &path) {
+    const auto extension = path.extension().string();
+    return std::ranges::find(k_extensions, extension) != k_extensions.end();
+}
+
+// one pass over `dir`: regular files whose name passes `keep`, sorted
+template <typename Keep>
+bool scan(const std::filesystem::path &dir, const Keep &keep, std::vector<std::string> &out) {
+    std::error_code ec;
+    std::filesystem::directory_iterator it(dir, ec);
+    if (ec) {
+        print("Failed to read config directory: ", dir.string(), " (", ec.message(), ")\n");
+        return false;
+    }
+
+    const auto first = out.size();
+    for (; it != std::filesystem::directory_iterator{}; it.increment(ec)) {
+        const auto &entry = *it;
+        const auto name = entry.path().filename().string();
+        // the type comes with the directory entry, no stat unless it is a symlink
+        if (!keep(name) || !entry.is_regular_file(ec)) continue;
+        out.push_back(entry.path().string());
+    }
+    if (ec) {
+        print("Failed to read config directory: ", dir.string(), " (", ec.message(), ")\n");
+        return false;
+    }
+    std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end());
+    return true;
+}
+
+} // namespace
+
+bool glob_match(std::string_view pattern, std::string_view name) {
+    // greedy with backtracking to the last `*`, linear for the usual patterns
+    size_t p = 0, n = 0;
+    size_t star = std::string_view::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            p += 1;
+            n += 1;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p += 1;
+    }
+    return p == pattern.size();
+}
+
+std::optional<std::vector<std::string>> expand_configs(const std::vector<std::string> &entries) {
+    std::vector<std::string> paths;
+    paths.reserve(entries.size());
+    for (const auto &entry : entries) {
+        const std::filesystem::path path(entry);
+        const auto pattern = path.filename().string();
+        const auto before = paths.size();
+
+        if (has_wildcard(pattern)) {
+            if (has_wildcard(path.parent_path().string())) {
+                print("Wildcards are only supported in the file name: ", entry, "\n");
+                return std::nullopt;
+            }
+            const auto dir = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+            // like a shell, `*` does not match hidden files
+            const bool hidden = pattern.starts_with('.');
+            const auto keep = [&](std::string_view name) {
+                return (hidden || !name.starts_with('.')) && glob_match(pattern, name);
+            };
+            if (!scan(dir, keep, paths)) return std::nullopt;
+        } else {
+            std::error_code ec;
+            const auto type = std::filesystem::status(path, ec).type();
+            if (type == std::filesystem::file_type::not_found) {
+                print("Config file does not exist: ", entry, "\n");
+                return std::nullopt;
+            }
+            if (type != std::filesystem::file_type::directory) {
+                paths.push_back(entry);
+                continue;
+            }
+            const auto keep = [](std::string_view name) {
+                return !name.starts_with('.') && is_frpc_config(std::filesystem::path(name));
+            };
+            if (!scan(path, keep, paths)) return std::nullopt;
+        }
+
+        if (paths.size() == before) print("No frpc configs match: ", entry, "\n");
+    }
+    return paths;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Expand the `configs` entries of the config file into frpc config paths.
+// An entry can be
+//   - a file path, kept as is,
+//   - a directory, standing for every frpc config (.toml, .yaml, .yml,
+//     .json, .ini) directly inside it,
+//   - a pattern with `*` and `?` in its file name ("conf.d/*.toml").
+// Each directory or pattern costs one scan of its directory, and the files
+// it yields are known to exist without a stat per file. Matches are sorted
+// by name, so instance order does not depend on the file system. A pattern
+// matching nothing is not an error; a missing file or an unreadable
+// directory is, and is reported.
+std::optional<std::vector<std::string>> expand_configs(const std::vector<std::string> &entries);
+
+// `*` and `?` against one file name; the other characters match themselves
+bool glob_match(std::string_view pattern, std::string_view name);
@@ -0,0 +1,134 @@
+#include "config_template.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "util/print.hpp"
+
+bool substitute(std::string_view text, const std::vector<std::string_view> &vars,
+                const std::vector<std::string_view> &values, std::string &out, std::string &missing) {
+    out.clear();
+    out.reserve(text.size());
+    while (!text.empty()) {
+        const auto start = text.find("${");
+        const auto end = start == std::string_view::npos ? start : text.find('}', start + 2);
+        if (end == std::string_view::npos) break;
+        out += text.substr(0, start);
+        const auto name = text.substr(start + 2, end - start - 2);
+        const auto it = std::ranges::find(vars, name);
+        if (it == vars.end()) {
+            missing.assign(name);
+            return false;
+        }
+        out += values[static_cast<size_t>(it - vars.begin())];
+        text.remove_prefix(end + 1);
+    }
+    out += text;
+    return true;
+}
+
+namespace {
+
+// the `${var}`s of one string field, in place; the field is optional
+bool substitute_field(std::optional<std::string> &field, const std::vector<std::string_view> &vars,
+                      const std::vector<std::string_view> &values, std::string &missing) {
+    if (!field) return true;
+    std::string out;
+    if (!substitute(*field, vars, values, out, missing)) return false;
+    *field = std::move(out);
+    return true;
+}
+
+bool render(const TemplateConfig &config, std::vector<RenderedInstance> &out) {
+    std::ifstream file(config.base, std::ios::binary);
+    if (!file) {
+        print("Failed to read template base: ", config.base, "\n");
+        return false;
+    }
+    const std::string base{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    // all variables side by side, each axis owning a contiguous range
+    std::vector<std::string_view> vars;
+    size_t combinations = 1;
+    if (config.matrix.empty()) {
+        print("Template ", config.base, " has an empty matrix\n");
+        return false;
+    }
+    for (const auto &axis : config.matrix) {
+        if (axis.rows.empty()) {
+            print("Template ", config.base, " has a matrix axis without rows\n");
+            return false;
+        }
+        for (const auto &var : axis.vars) {
+            if (std::ranges::find(vars, var) != vars.end()) {
+                print("Template ", config.base, " defines ${", var, "} twice\n");
+                return false;
+            }
+            vars.push_back(var);
+        }
+        for (const auto &row : axis.rows) {
+            if (row.size() != axis.vars.size()) {
+                print("Template ", config.base, " has a row with ", NumStr(static_cast<long long>(row.size())),
+                      " value(s) for ", NumStr(static_cast<long long>(axis.vars.size())), " variable(s)\n");
+                return false;
+            }
+        }
+        combinations *= axis.rows.size();
+    }
+
+    std::vector<std::string_view> values(vars.size());
+    std::vector<size_t> picks(config.matrix.size());
+    std::string missing;
+    out.reserve(out.size() + combinations);
+    for (size_t n = 0; n < combinations; ++n) {
+        // n in mixed radix, one digit per axis, the last one varying fastest
+        auto rest = n;
+        for (size_t axis = config.matrix.size(); axis-- > 0;) {
+            const auto count = config.matrix[axis].rows.size();
+            picks[axis] = rest % count;
+            rest /= count;
+        }
+        auto value = values.begin();
+        for (size_t axis = 0; axis < config.matrix.size(); ++axis) {
+            for (const auto &cell : config.matrix[axis].rows[picks[axis]]) {
+                *value++ = cell;
+            }
+        }
+
+        RenderedInstance rendered;
+        auto &instance = rendered.instance;
+        instance.config = config.base;
+        instance.name.emplace();
+        instance.restart = config.restart;
+        instance.health = config.health;
+        instance.cgroup = config.cgroup;
+        instance.sched = config.sched;
+        instance.network = config.network;
+        instance.limits = config.limits;
+        bool ok = substitute(config.name, vars, values, *instance.name, missing) &&
+                  substitute(base, vars, values, rendered.text, missing);
+        if (ok && instance.health) {
+            auto &health = *instance.health;
+            ok = substitute_field(health.tcp, vars, values, missing) &&
+                 substitute_field(health.http, vars, values, missing) &&
+                 substitute_field(health.path, vars, values, missing);
+        }
+        if (!ok) {
+            print("Template ", config.base, " uses ${", missing, "}, which no axis of its matrix defines\n");
+            return false;
+        }
+        out.push_back(std::move(rendered));
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<std::vector<RenderedInstance>> render_templates(const std::vector<TemplateConfig> &templates) {
+    std::vector<RenderedInstance> rendered;
+    for (const auto &config : templates) {
+        if (!render(config, rendered)) return std::nullopt;
+    }
+    return rendered;
+}
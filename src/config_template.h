@@ -0,0 +1,28 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config.hpp"
+
+// One instance generated from a template, with its frpc config in memory.
+// `instance.config` is the template's base file, for messages.
+struct RenderedInstance {
+    InstanceConfig instance;
+    std::string text;
+};
+
+// Expand `templates` into one instance per combination of a row from every
+// axis of its matrix, in row order with the last axis varying fastest. Each
+// base file is read once, however many instances it yields. A `${var}` that
+// no axis defines, a row of the wrong width or a variable defined by two
+// axes is reported and fails the whole expansion; `$` followed by anything
+// else is left alone.
+std::optional<std::vector<RenderedInstance>> render_templates(const std::vector<TemplateConfig> &templates);
+
+// `text` with every `${var}` replaced by `values[i]` where `vars[i] == var`;
+// false with the unknown name in `missing` when a variable is not defined
+bool substitute(std::string_view text, const std::vector<std::string_view> &vars,
+                const std::vector<std::string_view> &values, std::string &out, std::string &missing);
@@ -0,0 +1,173 @@
+#ifndef _WIN32
+
+#include "config_watcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "util/print.hpp"
+
+namespace {
+
+// long enough to coalesce an editor's write + rename + chmod burst
+constexpr auto k_debounce = std::chrono::milliseconds(250);
+
+constexpr uint32_t k_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE;
+
+constexpr uint64_t k_fnv_basis = 0xcbf29ce484222325ull;
+
+// FNV-1a, frpc configs are a few KB so the byte loop is plenty fast
+uint64_t fnv1a(uint64_t hash, std::string_view data) {
+    for (const unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+void ConfigWatcher::attach(EventLoop &loop) {
+    loop_ = &loop;
+    loop.reserve(watched_.size());
+    if (inotify_) loop.add(inotify_.get(), make_token(Source::WATCH));
+}
+
+void ConfigWatcher::set_files(std::vector<File> files) {
+    if (!inotify_ && !files.empty()) {
+        inotify_.reset(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        if (!inotify_) {
+            print("Failed to create inotify instance, config files are not watched\n");
+            return;
+        }
+        if (loop_) loop_->add(inotify_.get(), make_token(Source::WATCH));
+    }
+
+    if (loop_ && files.size() > watched_.size()) loop_->reserve(files.size() - watched_.size());
+    std::unordered_map<std::string_view, const Watched *> old_by_path;
+    old_by_path.reserve(watched_.size());
+    for (const auto &old : watched_) {
+        old_by_path.emplace(old.file.path, &old);
+    }
+    std::vector<Watched> watched(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto &entry = watched[i];
+        entry.file = std::move(files[i]);
+        const auto slash = entry.file.path.rfind('/');
+        entry.name_at = slash == std::string::npos ? 0 : slash + 1;
+
+        if (const auto found = old_by_path.find(entry.file.path); found != old_by_path.end()) {
+            const auto *old = found->second;
+            entry.hash = old->hash;
+            if (old->pending && loop_) {
+                // indices shift, so the pending deadline is re-issued
+                entry.pending = true;
+                entry.due = old->due;
+                entry.armed = old->due;
+                loop_->schedule(entry.due, make_token(Source::WATCH_DUE, static_cast<uint32_t>(i)));
+            }
+        } else if (!hash_file(entry.file.path, entry.hash)) {
+            print("Failed to read config file: ", entry.file.path, "\n");
+        }
+
+        // the same directory yields the same wd, so shared parents cost one watch
+        const auto dir = std::filesystem::path(entry.file.path).parent_path();
+        entry.wd = inotify_add_watch(inotify_.get(), dir.empty() ? "." : dir.c_str(), k_mask);
+        if (entry.wd < 0) {
+            print("Failed to watch directory of config file: ", entry.file.path, "\n");
+        }
+    }
+
+    std::unordered_set<int> kept;
+    kept.reserve(watched.size());
+    for (const auto &entry : watched) {
+        kept.insert(entry.wd);
+    }
+    for (const auto &old : watched_) {
+        // a directory watched twice is removed once, the second call fails harmlessly
+        if (old.wd >= 0 && !kept.contains(old.wd)) inotify_rm_watch(inotify_.get(), old.wd);
+    }
+    watched_ = std::move(watched);
+
+    by_name_.resize(watched_.size());
+    for (uint32_t i = 0; i < by_name_.size(); ++i) by_name_[i] = i;
+    std::ranges::sort(by_name_, {}, [this](uint32_t i) { return watched_[i].key(); });
+}
+
+void ConfigWatcher::arm(uint32_t index, EventLoop::Clock::time_point now) {
+    auto &entry = watched_[index];
+    entry.due = now + k_debounce;
+    if (entry.pending) return;
+    entry.pending = true;
+    entry.armed = entry.due;
+    loop_->schedule(entry.armed, make_token(Source::WATCH_DUE, index));
+}
+
+void ConfigWatcher::on_event() {
+    alignas(inotify_event) char buffer[4096];
+    const auto now = EventLoop::Clock::now();
+    while (true) {
+        const auto got = read(inotify_.get(), buffer, sizeof(buffer));
+        if (got <= 0) break;
+        for (ssize_t offset = 0; offset < got;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            if (event->mask & IN_Q_OVERFLOW) {
+                // events were dropped, any file may have changed
+                print("inotify queue overflowed, rechecking every config file\n");
+                for (uint32_t i = 0; i < watched_.size(); ++i) arm(i, now);
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            // every event pushes the deadline out, only the last one is acted on
+            const std::pair<int, std::string_view> key(event->wd, event->name); // NUL padded
+            const auto matches = std::ranges::equal_range(by_name_, key, {}, [this](uint32_t i) { return watched_[i].key(); });
+            for (const uint32_t i : matches) arm(i, now);
+        }
+    }
+}
+
+std::optional<std::string_view> ConfigWatcher::on_due(uint32_t index) {
+    if (index >= watched_.size()) return std::nullopt;
+    auto &entry = watched_[index];
+    const auto now = EventLoop::Clock::now();
+    // stale after set_files()
+    if (!entry.pending || now < entry.armed) return std::nullopt;
+    if (now < entry.due) {
+        // events came in since it was armed, wait for them to settle
+        entry.armed = entry.due;
+        loop_->schedule(entry.armed, make_token(Source::WATCH_DUE, index));
+        return std::nullopt;
+    }
+    entry.pending = false;
+
+    uint64_t hash;
+    // vanished mid-rename or deleted: nothing to restart into
+    if (!hash_file(entry.file.path, hash) || hash == entry.hash) return std::nullopt;
+    entry.hash = hash;
+    return entry.file.instance;
+}
+
+bool ConfigWatcher::hash_file(const std::string &path, uint64_t &hash) {
+    const UniqueFd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) return false;
+
+    uint64_t value = k_fnv_basis;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fd.get(), chunk, sizeof(chunk))) > 0) {
+        value = fnv1a(value, {chunk, static_cast<size_t>(got)});
+    }
+    if (got < 0) return false;
+    hash = value;
+    return true;
+}
+
+#endif // !_WIN32
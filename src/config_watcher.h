@@ -0,0 +1,65 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "process/event_loop.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// Notices when the frpc config of an instance really changed. The parent
+// directories are watched with inotify rather than the files, so editors
+// that save by renaming a temporary over the original are seen too. Events
+// for a file are debounced, then its content hash decides: a touch or an
+// identical rewrite changes nothing. A lost event queue (IN_Q_OVERFLOW)
+// makes every file due for a rehash.
+struct ConfigWatcher : Unique {
+    struct File {
+        std::string instance;
+        std::string path;
+    };
+
+    // Register the inotify fd under Source::WATCH, now or once it exists.
+    void attach(EventLoop &loop);
+
+    // Watch exactly `files` from now on; an empty list stops watching.
+    // Files that were already watched keep their hash.
+    void set_files(std::vector<File> files);
+
+    // Source::WATCH: collect the events and (re)arm the debounce deadlines.
+    void on_event();
+    // Source::WATCH_DUE deadline: the instance whose config content changed
+    // since it was last seen, if any.
+    std::optional<std::string_view> on_due(uint32_t index);
+
+private:
+    struct Watched {
+        File file;
+        size_t name_at = 0; // where the file name starts in file.path
+        int wd = -1;
+        uint64_t hash = 0;
+        bool pending = false;
+        EventLoop::Clock::time_point due{};
+        // the one WATCH_DUE deadline in the loop while pending; a later
+        // event only moves `due`, and the deadline re-arms itself there
+        EventLoop::Clock::time_point armed{};
+
+        std::pair<int, std::string_view> key() const { return {wd, std::string_view(file.path).substr(name_at)}; }
+    };
+
+    void arm(uint32_t index, EventLoop::Clock::time_point now);
+    static bool hash_file(const std::string &path, uint64_t &hash);
+
+    UniqueFd inotify_;
+    EventLoop *loop_ = nullptr;
+    std::vector<Watched> watched_;
+    // indices into watched_ sorted by (wd, file name), to find an event's file
+    std::vector<uint32_t> by_name_;
+};
+
+#endif // !_WIN32
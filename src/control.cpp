@@ -0,0 +1,222 @@
+#ifndef _WIN32
+
+#include "control.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "util/print.hpp"
+
+namespace {
+
+bool make_address(const std::string &path, sockaddr_un &address) {
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) text.remove_suffix(1);
+    while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+    return text;
+}
+
+} // namespace
+
+ControlServer::~ControlServer() {
+    if (listener_) unlink(path_.c_str());
+}
+
+bool ControlServer::listen(const std::string &path, EventLoop &loop) {
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        print("Control socket path is too long: ", path, "\n");
+        return false;
+    }
+
+    UniqueFd fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!fd) return false;
+
+    // a stale socket from a previous run would make bind fail
+    unlink(path.c_str());
+    if (bind(fd.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        chmod(path.c_str(), 0600) != 0 || ::listen(fd.get(), 16) != 0) {
+        print("Failed to listen on control socket: ", path, "\n");
+        return false;
+    }
+
+    path_ = path;
+    listener_ = std::move(fd);
+    // replies are copied into these and the capacity stays with the slot,
+    // so only a reply bigger than any before it allocates
+    for (auto &connection : connections_) connection.output.reserve(k_output_reserve);
+    loop_ = &loop;
+    return loop.add(listener_.get(), make_token(Source::CONTROL));
+}
+
+std::optional<ControlServer::Request> ControlServer::on_event(uint64_t token, uint32_t events) {
+    if (token_source(token) == Source::CONTROL) {
+        accept_all();
+        return std::nullopt;
+    }
+
+    const uint32_t slot = token_index(token);
+    if (slot >= connections_.size() || !connections_[slot].fd) return std::nullopt;
+
+    if (events & EPOLLOUT) {
+        flush(slot);
+        return std::nullopt;
+    }
+    if (events & EPOLLIN) {
+        return receive(slot);
+    }
+    drop(slot);
+    return std::nullopt;
+}
+
+void ControlServer::accept_all() {
+    while (true) {
+        UniqueFd fd(accept4(listener_.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+        if (!fd) return;
+
+        const auto free_slot = std::ranges::find_if(connections_, [](const Connection &c) { return !c.fd; });
+        if (free_slot == connections_.end()) continue; // busy, refuse by closing
+
+        const auto slot = static_cast<uint32_t>(free_slot - connections_.begin());
+        free_slot->fd = std::move(fd);
+        free_slot->received = 0;
+        free_slot->output.clear();
+        free_slot->sent = 0;
+        loop_->add(free_slot->fd.get(), make_token(Source::CONTROL_CLIENT, slot));
+    }
+}
+
+std::optional<ControlServer::Request> ControlServer::receive(uint32_t slot) {
+    auto &connection = connections_[slot];
+    const auto got = read(connection.fd.get(), connection.input.data() + connection.received,
+                          connection.input.size() - connection.received);
+    if (got < 0) {
+        if (errno != EAGAIN) drop(slot);
+        return std::nullopt;
+    }
+    connection.received += static_cast<size_t>(got);
+
+    const std::string_view input(connection.input.data(), connection.received);
+    const auto newline = input.find('\n');
+    if (newline == std::string_view::npos) {
+        if (connection.received == connection.input.size()) {
+            respond(slot, "error: request too long\n");
+        } else if (got == 0) {
+            drop(slot); // peer gave up before finishing a line
+        }
+        return std::nullopt;
+    }
+
+    // one request per connection: stop listening for input, so a client
+    // that half-closes does not keep waking us up
+    loop_->modify(connection.fd.get(), make_token(Source::CONTROL_CLIENT, slot), 0);
+
+    const auto line = trim(input.substr(0, newline));
+    const auto space = line.find(' ');
+    return Request{
+        .slot = slot,
+        .command = line.substr(0, space),
+        .argument = space == std::string_view::npos ? std::string_view{} : trim(line.substr(space + 1)),
+    };
+}
+
+void ControlServer::respond(uint32_t slot, std::string_view reply) {
+    auto &connection = connections_[slot];
+    if (!connection.fd) return;
+    connection.output.assign(reply);
+    connection.sent = 0;
+    flush(slot);
+}
+
+void ControlServer::flush(uint32_t slot) {
+    auto &connection = connections_[slot];
+    while (connection.sent < connection.output.size()) {
+        const auto sent = send(connection.fd.get(), connection.output.data() + connection.sent,
+                               connection.output.size() - connection.sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN) {
+                loop_->modify(connection.fd.get(), make_token(Source::CONTROL_CLIENT, slot), EPOLLOUT);
+                return;
+            }
+            break;
+        }
+        connection.sent += static_cast<size_t>(sent);
+    }
+    drop(slot);
+}
+
+void ControlServer::finish(int timeout_ms) {
+    using namespace std::chrono;
+    const auto deadline = steady_clock::now() + milliseconds(timeout_ms);
+    for (uint32_t slot = 0; slot < connections_.size(); ++slot) {
+        auto &connection = connections_[slot];
+        // flush() drops the connection once everything is out
+        while (connection.fd && connection.sent < connection.output.size()) {
+            const auto left = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+            pollfd writable{.fd = connection.fd.get(), .events = POLLOUT, .revents = 0};
+            if (left <= 0 || poll(&writable, 1, static_cast<int>(left)) <= 0) break;
+            flush(slot);
+        }
+    }
+}
+
+void ControlServer::drop(uint32_t slot) {
+    auto &connection = connections_[slot];
+    if (!connection.fd) return;
+    loop_->remove(connection.fd.get());
+    connection.fd.reset();
+}
+
+int control_request(const std::string &path, std::string_view request) {
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        print("Control socket path is too long: ", path, "\n");
+        return 1;
+    }
+
+    UniqueFd fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (!fd || connect(fd.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        print("Failed to connect to control socket: ", path, "\n");
+        return 1;
+    }
+
+    std::string line(request);
+    line += '\n';
+    if (send(fd.get(), line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())) {
+        print("Failed to send request\n");
+        return 1;
+    }
+    shutdown(fd.get(), SHUT_WR);
+
+    std::string reply;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(fd.get(), buffer, sizeof(buffer))) > 0) {
+        reply.append(buffer, static_cast<size_t>(got));
+    }
+
+    const std::string_view view(reply);
+    const auto newline = view.find('\n');
+    const auto status = view.substr(0, newline);
+    const auto body = newline == std::string_view::npos ? std::string_view{} : view.substr(newline + 1);
+    if (status != "ok") {
+        print(status.empty() ? "error: no reply" : status, "\n");
+        return 1;
+    }
+    print(body);
+    return 0;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef _WIN32
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "process/event_loop.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// Local control socket (AF_UNIX, stream). The protocol is one request line
+// per connection, "<command> [argument]\n", answered with "ok\n" or
+// "error: <reason>\n" plus an optional body, after which the server closes
+// the connection. Everything runs non-blocking inside the event loop.
+struct ControlServer : Unique {
+    struct Request {
+        uint32_t slot;
+        std::string_view command;
+        std::string_view argument;
+    };
+
+    ControlServer() = default;
+    ~ControlServer();
+
+    ControlServer(ControlServer &&) = delete;
+    ControlServer &operator=(ControlServer &&) = delete;
+
+    bool listen(const std::string &path, EventLoop &loop);
+    bool is_listening() const { return static_cast<bool>(listener_); }
+
+    // Handle readiness of a Source::CONTROL or Source::CONTROL_CLIENT token.
+    // Returns the request once a complete line has arrived on a connection.
+    std::optional<Request> on_event(uint64_t token, uint32_t events);
+
+    // Queue the reply for `slot` and send as much as the socket takes now,
+    // the rest goes out on EPOLLOUT.
+    void respond(uint32_t slot, std::string_view reply);
+
+    // Send the replies still queued, blocking for at most `timeout_ms`;
+    // for when the process is about to exec and its sockets go away.
+    void finish(int timeout_ms);
+
+private:
+    static constexpr size_t k_output_reserve = 4096;
+
+    struct Connection {
+        UniqueFd fd;
+        std::array<char, 512> input;
+        size_t received = 0;
+        std::string output;
+        size_t sent = 0;
+    };
+
+    void accept_all();
+    std::optional<Request> receive(uint32_t slot);
+    void flush(uint32_t slot);
+    void drop(uint32_t slot);
+
+    std::string path_;
+    UniqueFd listener_;
+    EventLoop *loop_ = nullptr;
+    std::array<Connection, 8> connections_;
+};
+
+// Client side for the CLI: send `request`, print the reply body, and return
+// the process exit code (0 for "ok").
+int control_request(const std::string &path, std::string_view request);
+
+#endif // !_WIN32
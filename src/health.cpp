@@ -0,0 +1,207 @@
+#ifndef _WIN32
+
+#include "health.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "process/trace.h"
+#include "util/print.hpp"
+
+bool resolve_address(std::string_view host_port, HealthCheck &check) {
+    const auto colon = host_port.rfind(':');
+    if (colon == std::string_view::npos) return false;
+    auto host = std::string(host_port.substr(0, colon));
+    const auto port = std::string(host_port.substr(colon + 1));
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    // probes target local ports, this resolves from /etc/hosts at worst
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) return false;
+    std::memcpy(&check.address, result->ai_addr, result->ai_addrlen);
+    check.address_size = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+std::string make_http_request(std::string_view host_port, std::string_view path, std::string_view credentials) {
+    std::string request = "GET ";
+    request += path;
+    request += " HTTP/1.1\r\nHost: ";
+    request += host_port;
+    request += "\r\nConnection: close\r\n";
+    if (!credentials.empty()) {
+        static constexpr char k_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        request += "Authorization: Basic ";
+        for (size_t i = 0; i < credentials.size(); i += 3) {
+            const auto byte = [&](size_t at) { return at < credentials.size() ? static_cast<uint8_t>(credentials[at]) : 0u; };
+            const uint32_t group = (byte(i) << 16) | (byte(i + 1) << 8) | byte(i + 2);
+            request += k_alphabet[(group >> 18) & 63];
+            request += k_alphabet[(group >> 12) & 63];
+            request += i + 1 < credentials.size() ? k_alphabet[(group >> 6) & 63] : '=';
+            request += i + 2 < credentials.size() ? k_alphabet[group & 63] : '=';
+        }
+        request += "\r\n";
+    }
+    request += "\r\n";
+    return request;
+}
+
+void HealthChecker::attach(EventLoop &loop) {
+    loop_ = &loop;
+    // the next probe, and the timeout of one in flight superseding it
+    loop.reserve(probes_.size() * 2);
+    for (uint32_t i = 0; i < probes_.size(); ++i) {
+        schedule(i, probes_[i].target.check.interval_ms);
+    }
+}
+
+void HealthChecker::set_targets(std::vector<Target> targets) {
+    if (loop_ && targets.size() > probes_.size()) loop_->reserve((targets.size() - probes_.size()) * 2);
+    std::unordered_map<std::string_view, const Probe *> old_by_name;
+    old_by_name.reserve(probes_.size());
+    for (const auto &old : probes_) {
+        old_by_name.emplace(old.target.instance, &old);
+    }
+    std::vector<Probe> probes(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto &probe = probes[i];
+        probe.target = std::move(targets[i]);
+        if (const auto found = old_by_name.find(probe.target.instance); found != old_by_name.end()) {
+            probe.failures = found->second->failures;
+            probe.pid = found->second->pid;
+        }
+    }
+    // closing the old sockets drops them from the epoll set
+    probes_ = std::move(probes);
+    if (!loop_) return;
+    for (uint32_t i = 0; i < probes_.size(); ++i) {
+        schedule(i, probes_[i].target.check.interval_ms);
+    }
+}
+
+void HealthChecker::schedule(uint32_t index, int delay_ms) {
+    auto &probe = probes_[index];
+    probe.due = EventLoop::Clock::now() + std::chrono::milliseconds(delay_ms);
+    loop_->schedule(probe.due, make_token(Source::PROBE_DUE, index));
+}
+
+std::optional<std::string_view> HealthChecker::on_due(uint32_t index, ProcessManager &manager) {
+    if (index >= probes_.size()) return std::nullopt;
+    auto &probe = probes_[index];
+    // a deadline that was superseded, or left over from before set_targets()
+    if (EventLoop::Clock::now() < probe.due) return std::nullopt;
+    if (probe.socket) return finish(index, "timed out", manager);
+
+    const auto &check = probe.target.check;
+    const int slot = manager.find(probe.target.instance);
+    const auto status = slot >= 0 ? manager.status(static_cast<uint32_t>(slot)) : InstanceStatus{};
+    const bool settling = status.uptime_ms < check.interval_ms;
+    if (slot < 0 || status.state != InstanceState::RUNNING || status.stopping || (settling && status.ready)) {
+        schedule(index, check.interval_ms);
+        return std::nullopt;
+    }
+    if (status.pid != probe.pid) {
+        // a fresh child starts with a clean record
+        probe.pid = status.pid;
+        probe.failures = 0;
+    }
+    probe.settling = settling;
+    return begin(index, manager);
+}
+
+std::optional<std::string_view> HealthChecker::begin(uint32_t index, ProcessManager &manager) {
+    auto &probe = probes_[index];
+    const auto &check = probe.target.check;
+    probe.sent = false;
+    probe.received = 0;
+    probe.socket.reset(socket(check.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!probe.socket) {
+        schedule(index, check.interval_ms);
+        return std::nullopt;
+    }
+
+    // the result of the connect shows up as EPOLLOUT either way
+    const int rc = connect(probe.socket.get(), reinterpret_cast<const sockaddr *>(&check.address), check.address_size);
+    if (rc != 0 && errno != EINPROGRESS) {
+        // loopback connects usually fail right away
+        return finish(index, errno == ECONNREFUSED ? "connection refused" : "connect failed", manager);
+    }
+    loop_->add(probe.socket.get(), make_token(Source::PROBE, index), EPOLLOUT);
+    schedule(index, check.timeout_ms);
+    return std::nullopt;
+}
+
+std::optional<std::string_view> HealthChecker::on_event(uint32_t index, uint32_t events, ProcessManager &manager) {
+    if (index >= probes_.size() || !probes_[index].socket) return std::nullopt;
+    auto &probe = probes_[index];
+    const auto &check = probe.target.check;
+    const int fd = probe.socket.get();
+
+    if (!probe.sent) {
+        int error = 0;
+        socklen_t size = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+        if (error != 0) return finish(index, error == ECONNREFUSED ? "connection refused" : "connect failed", manager);
+        if (check.kind == HealthCheck::Kind::TCP) return finish(index, nullptr, manager);
+
+        // a few hundred bytes always fit into a fresh socket's send buffer
+        const auto written = send(fd, check.request.data(), check.request.size(), MSG_NOSIGNAL);
+        if (written != static_cast<ssize_t>(check.request.size())) return finish(index, "send failed", manager);
+        probe.sent = true;
+        loop_->modify(fd, make_token(Source::PROBE, index), EPOLLIN);
+        return std::nullopt;
+    }
+
+    const auto got = recv(fd, probe.response.data() + probe.received, probe.response.size() - probe.received, 0);
+    if (got < 0 && errno == EAGAIN) return std::nullopt;
+    if (got > 0) probe.received += static_cast<size_t>(got);
+
+    // "HTTP/1.1 200 ..." is all that is needed from the answer
+    const std::string_view response(probe.response.data(), probe.received);
+    if (response.size() < 12 && got > 0 && !(events & (EPOLLHUP | EPOLLERR))) return std::nullopt;
+    // a reply cut short by EOF is a failed probe, not something to index into
+    const bool ok = response.size() >= 12 && response.starts_with("HTTP/1.") && response.substr(8, 4) == " 200";
+    return finish(index, ok ? nullptr : "bad HTTP response", manager);
+}
+
+std::optional<std::string_view> HealthChecker::finish(uint32_t index, const char *failure, ProcessManager &manager) {
+    auto &probe = probes_[index];
+    const auto &check = probe.target.check;
+    probe.socket.reset();
+    tracer().record(TraceKind::PROBE, probe.target.instance, failure ? 0 : 1);
+
+    if (!failure) {
+        schedule(index, check.interval_ms);
+        probe.failures = 0;
+        // frpc answers, so it is up whatever its readiness source
+        if (const int slot = manager.find(probe.target.instance); slot >= 0) {
+            manager.mark_ready(static_cast<uint32_t>(slot));
+        }
+        return std::nullopt;
+    }
+    if (probe.settling) {
+        // still logging in, try again soon
+        schedule(index, std::min(k_settle_ms, check.interval_ms));
+        return std::nullopt;
+    }
+    schedule(index, check.interval_ms);
+    probe.failures += 1;
+    print("Health probe of ", probe.target.instance, " failed: ", failure, " (", NumStr(probe.failures), "/",
+          NumStr(check.failures), ")\n");
+    if (probe.failures < check.failures) return std::nullopt;
+    probe.failures = 0;
+    return probe.target.instance;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef _WIN32
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <vector>
+
+#include "process/event_loop.h"
+#include "process/process_manager.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// One active probe of an instance: a TCP connect, or an HTTP GET that must
+// answer 200 (frpc's webServer /api/status).
+struct HealthCheck {
+    enum class Kind : unsigned char {
+        TCP,
+        HTTP,
+    };
+
+    Kind kind = Kind::TCP;
+    sockaddr_storage address{};
+    socklen_t address_size = 0;
+    std::string request; // complete HTTP request, built once
+    int interval_ms = 10000;
+    int timeout_ms = 2000;
+    int failures = 3; // consecutive failures before the instance is restarted
+};
+
+// "host:port" (or "[v6]:port") into `check.address`, false if it does not
+// resolve
+bool resolve_address(std::string_view host_port, HealthCheck &check);
+
+// GET `path` with optional basic auth, `credentials` is "user:password"
+std::string make_http_request(std::string_view host_port, std::string_view path, std::string_view credentials);
+
+// Runs every instance's probe from the event loop: non-blocking sockets
+// (Source::PROBE, the index is the probe) and one deadline per probe
+// (Source::PROBE_DUE) that is either the next probe or the running one's
+// timeout. During its first interval an instance that is not ready yet is
+// probed every k_settle_ms without counting failures, and the first passing
+// probe marks it ready; after that a starting frpc is no longer excused.
+struct HealthChecker : Unique {
+    struct Target {
+        std::string instance;
+        HealthCheck check;
+    };
+
+    void attach(EventLoop &loop);
+    // Probe exactly `targets` from now on. Failure counts of instances that
+    // stay are kept, probes in flight are dropped.
+    void set_targets(std::vector<Target> targets);
+
+    static constexpr int k_settle_ms = 500;
+
+    // Both return the instance to restart once its probe failed `failures`
+    // times in a row.
+    std::optional<std::string_view> on_due(uint32_t index, ProcessManager &manager);
+    std::optional<std::string_view> on_event(uint32_t index, uint32_t events, ProcessManager &manager);
+
+private:
+    struct Probe {
+        Target target;
+        UniqueFd socket;
+        bool sent = false; // HTTP request written, waiting for the status line
+        std::array<char, 32> response;
+        size_t received = 0;
+        int failures = 0;
+        int pid = -1; // the child the failures were counted against
+        bool settling = false; // not ready and within its first interval
+        EventLoop::Clock::time_point due{};
+    };
+
+    std::optional<std::string_view> begin(uint32_t index, ProcessManager &manager);
+    std::optional<std::string_view> finish(uint32_t index, const char *failure, ProcessManager &manager);
+    void schedule(uint32_t index, int delay_ms);
+
+    EventLoop *loop_ = nullptr;
+    std::vector<Probe> probes_;
+};
+
+#endif // !_WIN32
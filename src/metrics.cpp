@@ -0,0 +1,230 @@
+#ifndef _WIN32
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util/print.hpp"
+#include "util/unique_fd.hpp"
+
+namespace {
+
+constexpr InstanceState k_states[] = {
+    InstanceState::RUNNING,
+    InstanceState::QUEUED,
+    InstanceState::BACKOFF,
+    InstanceState::STOPPED,
+    InstanceState::PARKED,
+};
+
+void append_header(std::string &out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void append_label_value(std::string &out, std::string_view value) {
+    for (const char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+}
+
+void append_sample(std::string &out, std::string_view name, std::string_view instance, std::string_view value) {
+    out += name;
+    out += "{instance=\"";
+    append_label_value(out, instance);
+    out += "\"} ";
+    out += value;
+    out += '\n';
+}
+
+// milliseconds as decimal seconds, "12.034"
+void append_seconds(std::string &out, int64_t ms) {
+    out += NumStr(ms / 1000);
+    const auto frac = NumStr(1000 + ms % 1000);
+    out += '.';
+    out += std::string_view(frac).substr(1);
+}
+
+} // namespace
+
+void MetricsExporter::attach(EventLoop &loop) {
+    loop_ = &loop;
+    loop.reserve(1);
+    arm();
+}
+
+void MetricsExporter::configure(std::string file, int interval_ms) {
+    file_ = std::move(file);
+    temp_file_ = file_.empty() ? std::string{} : file_ + ".tmp";
+    interval_ms_ = interval_ms;
+    arm();
+}
+
+void MetricsExporter::arm() {
+    if (!loop_ || !enabled() || armed_) return;
+    armed_ = true;
+    next_ = EventLoop::Clock::now() + std::chrono::milliseconds(interval_ms_);
+    loop_->schedule(next_, make_token(Source::METRICS));
+}
+
+void MetricsExporter::on_due(ProcessManager &manager) {
+    if (!enabled()) {
+        armed_ = false;
+        return;
+    }
+    const auto now = EventLoop::Clock::now();
+    if (now < next_) return;
+
+    manager.sample_usage();
+    if (!file_.empty()) write_file(manager);
+
+    // fixed cadence, but never try to catch up on missed ticks
+    next_ = std::max(next_ + std::chrono::milliseconds(interval_ms_), now);
+    loop_->schedule(next_, make_token(Source::METRICS));
+}
+
+void MetricsExporter::render(const ProcessManager &manager, std::string &out) const {
+    const auto each = [&](auto &&emit) {
+        for (uint32_t i = 0; i < manager.size(); ++i) {
+            const auto status = manager.status(i);
+            if (status.state != InstanceState::REMOVED) emit(status);
+        }
+    };
+
+    append_header(out, "multi_frp_instance_state", "gauge", "Current state of the instance, 1 for the active one.");
+    each([&](const InstanceStatus &status) {
+        for (const auto state : k_states) {
+            out += "multi_frp_instance_state{instance=\"";
+            append_label_value(out, status.name);
+            out += "\",state=\"";
+            out += state_name(state);
+            out += "\"} ";
+            out += status.state == state ? '1' : '0';
+            out += '\n';
+        }
+    });
+
+    append_header(out, "multi_frp_instance_restarts_total", "counter", "Restarts since multi-frp started.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_restarts_total", status.name, NumStr(status.restarts));
+    });
+
+    append_header(out, "multi_frp_instance_uptime_seconds", "gauge", "Time since the running child was spawned.");
+    each([&](const InstanceStatus &status) {
+        out += "multi_frp_instance_uptime_seconds{instance=\"";
+        append_label_value(out, status.name);
+        out += "\"} ";
+        append_seconds(out, status.uptime_ms);
+        out += '\n';
+    });
+
+    append_header(out, "multi_frp_instance_ready", "gauge", "1 once the running child has logged in to its frps.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_ready", status.name, status.ready ? "1" : "0");
+    });
+
+    append_header(out, "multi_frp_instance_time_to_ready_seconds", "gauge",
+                  "Time from the spawn of the running child until it was ready, -1 before.");
+    each([&](const InstanceStatus &status) {
+        out += "multi_frp_instance_time_to_ready_seconds{instance=\"";
+        append_label_value(out, status.name);
+        out += "\"} ";
+        if (status.ready_ms < 0) {
+            out += "-1";
+        } else {
+            append_seconds(out, status.ready_ms);
+        }
+        out += '\n';
+    });
+
+    append_header(out, "multi_frp_instance_last_exit_code", "gauge", "Exit code of the last exit, -1 before the first.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_last_exit_code", status.name, NumStr(status.last_exit_code));
+    });
+
+    append_header(out, "multi_frp_instance_last_exit_signal", "gauge", "Signal that ended the last run, 0 if none.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_last_exit_signal", status.name, NumStr(status.last_signal));
+    });
+
+    append_header(out, "multi_frp_instance_resident_memory_bytes", "gauge", "Resident set size of the child.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_resident_memory_bytes", status.name, NumStr(status.usage.rss_bytes));
+    });
+
+    append_header(out, "multi_frp_instance_cpu_seconds_total", "counter", "User and system CPU time of the running child.");
+    each([&](const InstanceStatus &status) {
+        out += "multi_frp_instance_cpu_seconds_total{instance=\"";
+        append_label_value(out, status.name);
+        out += "\"} ";
+        append_seconds(out, status.usage.cpu_ms);
+        out += '\n';
+    });
+
+    append_header(out, "multi_frp_instance_cgroup_memory_bytes", "gauge",
+                  "memory.current of the instance's cgroup, 0 without one.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_cgroup_memory_bytes", status.name,
+                      NumStr(status.usage.cgroup_memory_bytes));
+    });
+
+    append_header(out, "multi_frp_instance_cgroup_cpu_seconds_total", "counter",
+                  "CPU time of everything in the instance's cgroup, 0 without one.");
+    each([&](const InstanceStatus &status) {
+        out += "multi_frp_instance_cgroup_cpu_seconds_total{instance=\"";
+        append_label_value(out, status.name);
+        out += "\"} ";
+        append_seconds(out, status.usage.cgroup_cpu_ms);
+        out += '\n';
+    });
+
+    append_header(out, "multi_frp_instance_open_fds", "gauge", "Open file descriptors of the child.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_open_fds", status.name, NumStr(status.usage.fds));
+    });
+
+    append_header(out, "multi_frp_instance_threads", "gauge", "Threads of the child.");
+    each([&](const InstanceStatus &status) {
+        append_sample(out, "multi_frp_instance_threads", status.name, NumStr(status.usage.threads));
+    });
+}
+
+void MetricsExporter::write_file(const ProcessManager &manager) {
+    text_.clear();
+    render(manager, text_);
+
+    // write next to the target and rename over it, a scrape never sees a
+    // half written file
+    const UniqueFd fd(open(temp_file_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd) {
+        print("Failed to write metrics file: ", temp_file_, "\n");
+        return;
+    }
+    std::string_view rest = text_;
+    while (!rest.empty()) {
+        const auto written = write(fd.get(), rest.data(), rest.size());
+        if (written <= 0) return;
+        rest.remove_prefix(static_cast<size_t>(written));
+    }
+    std::rename(temp_file_.c_str(), file_.c_str());
+}
+
+#endif // !_WIN32
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef _WIN32
+
+#include <string>
+
+#include "process/event_loop.h"
+#include "process/process_manager.h"
+#include "util/trait.hpp"
+
+// Prometheus text exposition of every instance's state and resource usage.
+// Children are sampled on a timer (Source::METRICS deadlines), so scraping
+// only formats what was already collected. The text is served by the
+// `metrics` control command and, when a file is configured, rewritten
+// atomically after each sample for node_exporter's textfile collector.
+struct MetricsExporter : Unique {
+    void attach(EventLoop &loop);
+    // `interval_ms` <= 0 turns sampling off, `file` may be empty
+    void configure(std::string file, int interval_ms);
+    bool enabled() const { return interval_ms_ > 0; }
+
+    void on_due(ProcessManager &manager);
+    void render(const ProcessManager &manager, std::string &out) const;
+
+private:
+    void arm();
+    void write_file(const ProcessManager &manager);
+
+    EventLoop *loop_ = nullptr;
+    std::string file_;
+    std::string temp_file_;
+    int interval_ms_ = 0;
+    bool armed_ = false;
+    EventLoop::Clock::time_point next_{};
+    std::string text_; // reused between file writes
+};
+
+#endif // !_WIN32
@@ -0,0 +1,201 @@
+#ifndef _WIN32
+
+#include "net_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "util/print.hpp"
+
+namespace {
+
+// IFF_LOWER_UP lives in <linux/if.h>, which clashes with <net/if.h>
+constexpr unsigned k_iff_lower_up = 1 << 16;
+constexpr unsigned k_link_flags = IFF_UP | IFF_RUNNING | k_iff_lower_up;
+
+// flapping links still get acted on, at the latest this many debounce
+// periods after the first change
+constexpr int k_max_settle = 5;
+
+const char *attribute(const rtattr *attr, int length, unsigned short type) {
+    for (; RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        if (attr->rta_type == type) return static_cast<const char *>(RTA_DATA(attr));
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void NetworkWatcher::attach(EventLoop &loop) {
+    loop_ = &loop;
+    loop.reserve(1);
+    if (socket_) loop.add(socket_.get(), make_token(Source::NETWORK));
+}
+
+void NetworkWatcher::set_rules(std::vector<Rule> rules, int debounce_ms) {
+    if (!socket_ && !rules.empty()) {
+        socket_.reset(socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE));
+        sockaddr_nl address{};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE |
+                            RTMGRP_IPV6_ROUTE;
+        if (!socket_ || bind(socket_.get(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            print("Failed to subscribe to network changes, rules are not applied\n");
+            socket_.reset();
+            return;
+        }
+        // a burst while failing over should not overflow into ENOBUFS
+        const int size = 1 << 20;
+        setsockopt(socket_.get(), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        if (loop_) loop_->add(socket_.get(), make_token(Source::NETWORK));
+    }
+    rules_ = std::move(rules);
+    matched_.clear();
+    matched_.reserve(rules_.size());
+    debounce_ms_ = std::max(debounce_ms, 0);
+}
+
+void NetworkWatcher::on_event() {
+    alignas(nlmsghdr) char buffer[16384];
+    while (true) {
+        const auto got = recv(socket_.get(), buffer, sizeof(buffer), 0);
+        if (got < 0 && errno == ENOBUFS) {
+            // notifications were dropped, assume the worst
+            note(LINK | ADDRESS | ROUTE, 0, nullptr);
+            continue;
+        }
+        if (got <= 0) break;
+
+        auto length = static_cast<unsigned>(got);
+        for (auto *header = reinterpret_cast<const nlmsghdr *>(buffer); NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            switch (header->nlmsg_type) {
+                case RTM_NEWLINK:
+                case RTM_DELLINK: {
+                    const auto *info = static_cast<const ifinfomsg *>(NLMSG_DATA(header));
+                    if (info->ifi_flags & IFF_LOOPBACK) break;
+                    // a NEWLINK for an MTU or statistics change is no uplink switch
+                    if (header->nlmsg_type == RTM_NEWLINK && (info->ifi_change & k_link_flags) == 0) break;
+                    const auto *name = attribute(IFLA_RTA(info), static_cast<int>(IFLA_PAYLOAD(header)), IFLA_IFNAME);
+                    note(LINK, info->ifi_index, name);
+                    break;
+                }
+                case RTM_NEWADDR:
+                case RTM_DELADDR: {
+                    const auto *info = static_cast<const ifaddrmsg *>(NLMSG_DATA(header));
+                    // link-local and host addresses carry no tunnels
+                    if (info->ifa_scope >= RT_SCOPE_LINK) break;
+                    note(ADDRESS, static_cast<int>(info->ifa_index), nullptr);
+                    break;
+                }
+                case RTM_NEWROUTE:
+                case RTM_DELROUTE: {
+                    const auto *info = static_cast<const rtmsg *>(NLMSG_DATA(header));
+                    if (info->rtm_dst_len != 0 || info->rtm_table == RT_TABLE_LOCAL || info->rtm_type != RTN_UNICAST ||
+                        (info->rtm_flags & RTM_F_CLONED)) {
+                        break;
+                    }
+                    const auto *oif = attribute(RTM_RTA(info), static_cast<int>(RTM_PAYLOAD(header)), RTA_OIF);
+                    int ifindex = 0;
+                    if (oif) std::memcpy(&ifindex, oif, sizeof(ifindex));
+                    note(ROUTE, ifindex, nullptr);
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+}
+
+void NetworkWatcher::note(uint8_t change, int ifindex, const char *name) {
+    if (rules_.empty()) return;
+    changes_ |= change;
+
+    // a deleted link can no longer be looked up, hence the name from the message
+    char buffer[IF_NAMESIZE];
+    if (!name && ifindex > 0) name = if_indextoname(static_cast<unsigned>(ifindex), buffer);
+    if (!name) {
+        any_interface_ = true;
+    } else if (std::ranges::none_of(interfaces_.begin(), interfaces_.begin() + interface_count_,
+                                    [&](const auto &known) { return std::strcmp(known.data(), name) == 0; })) {
+        if (interface_count_ < k_max_interfaces) {
+            std::strncpy(interfaces_[interface_count_].data(), name, IF_NAMESIZE - 1);
+            interface_count_ += 1;
+        } else {
+            any_interface_ = true;
+        }
+    }
+
+    // every change pushes the deadline out, one pending deadline is enough
+    const auto now = EventLoop::Clock::now();
+    if (first_ == EventLoop::Clock::time_point{}) first_ = now;
+    last_ = now;
+    if (due_ == EventLoop::Clock::time_point{} && loop_) {
+        due_ = now + std::chrono::milliseconds(debounce_ms_);
+        loop_->schedule(due_, make_token(Source::NETWORK_DUE));
+    }
+}
+
+bool NetworkWatcher::matches(const Rule &rule) const {
+    if ((rule.changes & changes_) == 0) return false;
+    if (rule.interfaces.empty() || any_interface_) return true;
+    return std::ranges::any_of(interfaces_.begin(), interfaces_.begin() + interface_count_, [&](const auto &name) {
+        return std::ranges::find(rule.interfaces, std::string_view(name.data())) != rule.interfaces.end();
+    });
+}
+
+std::span<const NetworkWatcher::Rule *const> NetworkWatcher::on_due() {
+    using namespace std::chrono;
+    matched_.clear();
+    const auto now = EventLoop::Clock::now();
+    if (changes_ == 0 || due_ == EventLoop::Clock::time_point{} || now < due_) return {};
+
+    const auto debounce = milliseconds(debounce_ms_);
+    const auto settled = std::min(last_ + debounce, first_ + debounce * k_max_settle);
+    if (now < settled) {
+        due_ = settled;
+        loop_->schedule(due_, make_token(Source::NETWORK_DUE));
+        return {};
+    }
+
+    for (const auto &rule : rules_) {
+        if (matches(rule)) matched_.push_back(&rule);
+    }
+    // a flapping link brings this round often, the line is built on the stack:
+    // the three labels, " on " and every interface name with its separator
+    std::array<char, 32 + k_max_interfaces * IF_NAMESIZE> what;
+    size_t length = 0;
+    const auto append = [&](std::string_view text) {
+        std::memcpy(what.data() + length, text.data(), text.size());
+        length += text.size();
+    };
+    for (const auto &[change, label] : {std::pair{LINK, "link"}, std::pair{ADDRESS, "address"}, std::pair{ROUTE, "route"}}) {
+        if ((changes_ & change) == 0) continue;
+        if (length > 0) append(", ");
+        append(label);
+    }
+    if (!any_interface_) {
+        for (size_t i = 0; i < interface_count_; ++i) {
+            append(i == 0 ? " on " : " ");
+            append(interfaces_[i].data());
+        }
+    }
+    print("Network changed (", std::string_view(what.data(), length), "), ",
+          NumStr(static_cast<long long>(matched_.size())), " instance(s) affected\n");
+
+    changes_ = 0;
+    interface_count_ = 0;
+    any_interface_ = false;
+    first_ = {};
+    last_ = {};
+    due_ = {};
+    return matched_;
+}
+
+#endif // !_WIN32
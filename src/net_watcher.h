@@ -0,0 +1,69 @@
+#pragma once
+#ifndef _WIN32
+
+#include <array>
+#include <cstdint>
+#include <net/if.h>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "process/event_loop.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// Follows the host's rtnetlink notifications, so frpc can be restarted right
+// after an uplink switch instead of sitting on dead connections until its
+// heartbeat times out. Links going up or down, global addresses coming and
+// going, and default routes changing are collected until the network has
+// been quiet for the debounce time (a Source::NETWORK_DUE deadline), then
+// matched against the instances' rules in one go.
+struct NetworkWatcher : Unique {
+    enum Change : uint8_t {
+        LINK = 1,
+        ADDRESS = 2,
+        ROUTE = 4, // a default route
+    };
+
+    struct Rule {
+        std::string instance;
+        uint8_t changes = ADDRESS | ROUTE;
+        std::vector<std::string> interfaces; // empty for any
+        int signal = 0; // 0 restarts the instance
+    };
+
+    // Register the netlink socket under Source::NETWORK, now or once it exists.
+    void attach(EventLoop &loop);
+
+    // The socket is opened with the first rule and kept afterwards.
+    void set_rules(std::vector<Rule> rules, int debounce_ms);
+
+    // Source::NETWORK: collect the notifications and push the deadline out.
+    void on_event();
+    // Source::NETWORK_DUE: the rules matching what changed, empty while the
+    // network is still settling or the deadline is stale.
+    std::span<const Rule *const> on_due();
+
+private:
+    static constexpr size_t k_max_interfaces = 8;
+
+    void note(uint8_t change, int ifindex, const char *name);
+    bool matches(const Rule &rule) const;
+
+    UniqueFd socket_;
+    EventLoop *loop_ = nullptr;
+    std::vector<Rule> rules_;
+    std::vector<const Rule *> matched_;
+    int debounce_ms_ = 2000;
+
+    // pending changes since the last on_due()
+    uint8_t changes_ = 0;
+    std::array<std::array<char, IF_NAMESIZE>, k_max_interfaces> interfaces_{};
+    size_t interface_count_ = 0;
+    bool any_interface_ = false; // more interfaces than fit, or lost events
+    EventLoop::Clock::time_point first_{};
+    EventLoop::Clock::time_point last_{};
+    EventLoop::Clock::time_point due_{}; // pending deadline, if any
+};
+
+#endif // !_WIN32
@@ -0,0 +1,98 @@
+#ifndef _WIN32
+
+#include "notify.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "util/print.hpp"
+
+namespace {
+
+// the number in an environment variable, 0 when unset or malformed
+long long env_number(const char *name) {
+    const char *value = std::getenv(name);
+    long long number = 0;
+    if (value) std::from_chars(value, value + std::strlen(value), number);
+    return number;
+}
+
+} // namespace
+
+bool Notifier::open() {
+    const char *path = std::getenv("NOTIFY_SOCKET");
+    const std::string_view name = path ? path : "";
+
+    // the watchdog is only meant for us when WATCHDOG_PID is unset or ours
+    const auto watchdog_pid = env_number("WATCHDOG_PID");
+    if (watchdog_pid == 0 || watchdog_pid == getpid()) {
+        watchdog_ms_ = static_cast<int>(env_number("WATCHDOG_USEC") / 2000);
+    }
+    unsetenv("NOTIFY_SOCKET");
+    unsetenv("WATCHDOG_USEC");
+    unsetenv("WATCHDOG_PID");
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (name.empty() || name.size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, name.data(), name.size());
+    // "@name" is a socket in the abstract namespace
+    if (name.front() == '@') address.sun_path[0] = '\0';
+    const auto size = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + name.size());
+
+    UniqueFd fd(socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+    if (!fd || connect(fd.get(), reinterpret_cast<const sockaddr *>(&address), size) != 0) {
+        print("Failed to connect to the notify socket: ", name, "\n");
+        return false;
+    }
+    socket_ = std::move(fd);
+    path_ = name;
+    return true;
+}
+
+void Notifier::export_env(bool exported) const {
+    if (!enabled()) return;
+    if (!exported) {
+        unsetenv("NOTIFY_SOCKET");
+        unsetenv("WATCHDOG_USEC");
+        unsetenv("WATCHDOG_PID");
+        return;
+    }
+    setenv("NOTIFY_SOCKET", path_.c_str(), 1);
+    if (watchdog_ms_ > 0) {
+        setenv("WATCHDOG_USEC", std::to_string(static_cast<long long>(watchdog_ms_) * 2000).c_str(), 1);
+        setenv("WATCHDOG_PID", std::to_string(getpid()).c_str(), 1);
+    }
+}
+
+void Notifier::attach(EventLoop &loop) {
+    loop_ = &loop;
+    loop.reserve(1);
+    arm();
+}
+
+void Notifier::arm() {
+    if (!loop_ || !enabled() || watchdog_ms_ <= 0) return;
+    next_ = EventLoop::Clock::now() + std::chrono::milliseconds(watchdog_ms_);
+    loop_->schedule(next_, make_token(Source::WATCHDOG));
+}
+
+void Notifier::on_due() {
+    if (EventLoop::Clock::now() < next_) return;
+    send("WATCHDOG=1");
+    arm();
+}
+
+void Notifier::send_message(std::string_view message) {
+    if (!socket_) return;
+    // a datagram either goes out whole or not at all; systemd being gone or
+    // slow is no reason to hold up the loop
+    ::send(socket_.get(), message.data(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+#endif // !_WIN32
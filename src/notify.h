@@ -0,0 +1,53 @@
+#pragma once
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "process/event_loop.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// systemd's notify protocol without libsystemd: one datagram per message to
+// the unix socket in $NOTIFY_SOCKET. Inert unless multi-frp was started as a
+// Type=notify service (or by a stand-in that sets the variable). With
+// WatchdogSec=, WATCHDOG=1 is sent from the event loop at half the interval
+// (Source::WATCHDOG deadlines), so a stuck loop shows up as a missed ping.
+struct Notifier : Unique {
+    // Read and unset $NOTIFY_SOCKET and $WATCHDOG_USEC, frpc has no use for them.
+    bool open();
+    bool enabled() const { return static_cast<bool>(socket_); }
+    // Put the variables back for a re-exec of multi-frp, which is still the
+    // same service (pid) to systemd; `false` takes them away again.
+    void export_env(bool exported) const;
+
+    void attach(EventLoop &loop);
+    void on_due();
+
+    // "READY=1", "STATUS=...", "STOPPING=1"; pieces are joined on the stack
+    template <std::convertible_to<std::string_view>... Args>
+    void send(Args &&...args) {
+        char buffer[256];
+        size_t size = 0;
+        for (const auto piece : {std::string_view(args)...}) {
+            const auto count = std::min(piece.size(), sizeof(buffer) - size);
+            std::memcpy(buffer + size, piece.data(), count);
+            size += count;
+        }
+        send_message({buffer, size});
+    }
+
+private:
+    void send_message(std::string_view message);
+    void arm();
+
+    UniqueFd socket_;
+    std::string path_;
+    EventLoop *loop_ = nullptr;
+    int watchdog_ms_ = 0;
+    EventLoop::Clock::time_point next_{};
+};
+
+#endif // !_WIN32
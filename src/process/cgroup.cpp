@@ -0,0 +1,184 @@
+#ifndef _WIN32
+
+#include "process/cgroup.h"
+
+#include <cerrno>
+#include <charconv>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/print.hpp"
+
+namespace {
+
+bool write_at(int dir, const char *name, std::string_view value) {
+    const UniqueFd fd(openat(dir, name, O_WRONLY | O_CLOEXEC));
+    if (!fd) return false;
+    return write(fd.get(), value.data(), value.size()) == static_cast<ssize_t>(value.size());
+}
+
+// mount point of the cgroup2 hierarchy, from /proc/self/mountinfo
+std::string find_mount() {
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    std::string line;
+    while (std::getline(mountinfo, line)) {
+        // "... <mount point> <options> [optional fields] - cgroup2 ..."
+        const auto separator = line.find(" - cgroup2 ");
+        if (separator == std::string::npos) continue;
+        size_t field = 0;
+        for (int skip = 0; skip < 4 && field != std::string::npos; ++skip) {
+            field = line.find(' ', field + 1);
+        }
+        if (field == std::string::npos) continue;
+        const auto end = line.find(' ', field + 1);
+        return line.substr(field + 1, end - field - 1);
+    }
+    return {};
+}
+
+// our own cgroup v2 path, the "0::" line of /proc/self/cgroup
+std::string find_own_cgroup() {
+    std::ifstream cgroup("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroup, line)) {
+        if (line.starts_with("0::")) return line.substr(3);
+    }
+    return {};
+}
+
+int64_t parse_number(std::string_view text) {
+    int64_t value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+} // namespace
+
+bool CgroupTree::init() {
+    const auto mount = find_mount();
+    const auto own = find_own_cgroup();
+    if (mount.empty() || own.empty()) {
+        print("No cgroup v2 hierarchy found, instances run without cgroups\n");
+        return false;
+    }
+    auto base = mount + (own == "/" ? "" : own);
+    // after a re-exec we already live in our leaf
+    if (base.ends_with("/supervisor")) base.resize(base.size() - std::string_view("/supervisor").size());
+
+    const auto leaf = base + "/supervisor";
+    if (mkdir(leaf.c_str(), 0755) != 0 && errno != EEXIST) {
+        print("Cgroup ", base, " is not delegated to us, instances run without cgroups\n");
+        return false;
+    }
+    const UniqueFd leaf_fd(open(leaf.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!leaf_fd || !write_at(leaf_fd.get(), "cgroup.procs", "0")) {
+        print("Failed to move multi-frp into ", leaf, ", instances run without cgroups\n");
+        return false;
+    }
+
+    // Fails when the controllers are not delegated or other processes
+    // still live in our old cgroup; the children are then still grouped,
+    // so stop and accounting of the cpu time keep working, only unlimited.
+    const UniqueFd base_fd(open(base.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    controllers_ = base_fd && write_at(base_fd.get(), "cgroup.subtree_control", "+memory +cpu +pids");
+    if (!controllers_) {
+        print("Could not enable the memory, cpu and pids controllers in ", base, ", limits are not applied\n");
+    }
+    path_ = std::move(base);
+    return true;
+}
+
+Cgroup::~Cgroup() {
+    destroy();
+}
+
+Cgroup &Cgroup::operator=(Cgroup &&other) noexcept {
+    if (this != &other) {
+        destroy();
+        path_ = std::move(other.path_);
+        dir_ = std::move(other.dir_);
+        memory_current_ = std::move(other.memory_current_);
+        cpu_stat_ = std::move(other.cpu_stat_);
+        limits_ = other.limits_;
+    }
+    return *this;
+}
+
+bool Cgroup::create(const CgroupTree &tree, std::string_view name, const CgroupLimits &limits) {
+    destroy();
+    path_ = tree.path();
+    path_ += "/frpc-";
+    // instance names may be paths, a cgroup name is a single component
+    for (const char c : name) {
+        path_ += c == '/' ? '_' : c;
+    }
+    if (mkdir(path_.c_str(), 0755) != 0 && errno != EEXIST) {
+        print("Failed to create cgroup: ", path_, "\n");
+        path_.clear();
+        return false;
+    }
+    dir_.reset(open(path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!dir_) {
+        path_.clear();
+        return false;
+    }
+    memory_current_.reset(openat(dir_.get(), "memory.current", O_RDONLY | O_CLOEXEC));
+    cpu_stat_.reset(openat(dir_.get(), "cpu.stat", O_RDONLY | O_CLOEXEC));
+    if (tree.has_controllers()) apply(limits);
+    return true;
+}
+
+bool Cgroup::apply(const CgroupLimits &limits) {
+    if (!dir_) return false;
+    const NumStr memory(limits.memory_max);
+    const NumStr weight(limits.cpu_weight > 0 ? limits.cpu_weight : 100);
+    const NumStr pids(limits.pids_max);
+    bool ok = true;
+    ok &= write_file("memory.max", limits.memory_max > 0 ? std::string_view(memory) : "max");
+    ok &= write_file("cpu.weight", weight);
+    ok &= write_file("pids.max", limits.pids_max > 0 ? std::string_view(pids) : "max");
+    if (!ok) print("Failed to apply the limits of cgroup: ", path_, "\n");
+    // after a failed write the next apply retries, even with the same limits
+    limits_ = ok ? std::optional(limits) : std::nullopt;
+    return ok;
+}
+
+bool Cgroup::kill() {
+    return dir_ && write_file("cgroup.kill", "1");
+}
+
+bool Cgroup::sample(int64_t &memory_bytes, int64_t &cpu_usec) {
+    char buffer[512];
+    if (memory_current_) {
+        const auto got = pread(memory_current_.get(), buffer, sizeof(buffer), 0);
+        if (got > 0) memory_bytes = parse_number({buffer, static_cast<size_t>(got)});
+    }
+    if (!cpu_stat_) return false;
+    const auto got = pread(cpu_stat_.get(), buffer, sizeof(buffer), 0);
+    if (got <= 0) return false;
+    // first line: "usage_usec <n>"
+    const std::string_view stat(buffer, static_cast<size_t>(got));
+    const auto space = stat.find(' ');
+    if (space == std::string_view::npos) return false;
+    cpu_usec = parse_number(stat.substr(space + 1));
+    return true;
+}
+
+void Cgroup::destroy() {
+    if (!dir_) return;
+    memory_current_.reset();
+    cpu_stat_.reset();
+    dir_.reset();
+    limits_.reset();
+    // still busy if a process outlived its kill, leave it for the next run
+    rmdir(path_.c_str());
+    path_.clear();
+}
+
+bool Cgroup::write_file(const char *name, std::string_view value) {
+    return write_at(dir_.get(), name, value);
+}
+
+#endif // !_WIN32
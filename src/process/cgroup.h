@@ -0,0 +1,73 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// resource limits of one instance's cgroup, 0 leaves the kernel default
+struct CgroupLimits {
+    int64_t memory_max = 0; // bytes
+    int cpu_weight = 0;     // 1..10000, 100 is the kernel default
+    int pids_max = 0;
+
+    bool operator==(const CgroupLimits &) const = default;
+};
+
+// The cgroup v2 subtree delegated to the supervisor. The supervisor moves
+// itself into a "supervisor" leaf so the controllers can be enabled for
+// the instances' sibling cgroups (no internal processes rule).
+struct CgroupTree : Unique {
+    // false when there is no writable cgroup v2 hierarchy for us
+    bool init();
+    bool is_ready() const { return !path_.empty(); }
+    const std::string &path() const { return path_; }
+    // memory, cpu and pids could all be enabled for the children
+    bool has_controllers() const { return controllers_; }
+
+private:
+    std::string path_;
+    bool controllers_ = false;
+};
+
+// One instance's cgroup. Children are spawned straight into it with
+// CLONE_INTO_CGROUP, so even their first instruction is accounted and
+// limited, and cgroup.kill takes down whatever they forked as well.
+struct Cgroup : Unique {
+    Cgroup() = default;
+    ~Cgroup();
+    Cgroup(Cgroup &&) = default;
+    Cgroup &operator=(Cgroup &&other) noexcept;
+
+    bool create(const CgroupTree &tree, std::string_view name, const CgroupLimits &limits);
+    bool apply(const CgroupLimits &limits);
+    // the limits last applied, none after a failed write
+    const std::optional<CgroupLimits> &limits() const { return limits_; }
+    explicit operator bool() const { return static_cast<bool>(dir_); }
+    // directory fd, for CLONE_INTO_CGROUP
+    int fd() const { return dir_.get(); }
+
+    // SIGKILL every process in the cgroup (Linux 5.14+); false if that is
+    // not supported and the caller has to signal the child itself
+    bool kill();
+    // memory.current and the usage_usec line of cpu.stat, read with pread
+    // from descriptors kept open
+    bool sample(int64_t &memory_bytes, int64_t &cpu_usec);
+    // remove the (empty) cgroup
+    void destroy();
+
+private:
+    bool write_file(const char *name, std::string_view value);
+
+    std::string path_;
+    UniqueFd dir_;
+    UniqueFd memory_current_;
+    UniqueFd cpu_stat_;
+    std::optional<CgroupLimits> limits_;
+};
+
+#endif // !_WIN32
@@ -0,0 +1,119 @@
+#ifndef _WIN32
+
+#include "process/event_loop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t k_timer_token = make_token(Source::TIMER);
+
+constexpr auto later = [](const auto &lhs, const auto &rhs) { return lhs.when > rhs.when; };
+
+} // namespace
+
+EventLoop::EventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd_ >= 0 && timer_fd_ >= 0) {
+        add(timer_fd_, k_timer_token);
+    }
+}
+
+EventLoop::~EventLoop() {
+    if (timer_fd_ >= 0) close(timer_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool EventLoop::is_valid() const {
+    return epoll_fd_ >= 0 && timer_fd_ >= 0;
+}
+
+bool EventLoop::add(int fd, uint64_t token, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = token;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool EventLoop::modify(int fd, uint64_t token, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = token;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::schedule(Clock::time_point when, uint64_t token) {
+    deadlines_.push_back({when, token});
+    std::push_heap(deadlines_.begin(), deadlines_.end(), later);
+    if (deadlines_.front().token == token && deadlines_.front().when == when) {
+        rearm();
+    }
+}
+
+void EventLoop::reserve(size_t count) {
+    reserved_ += count;
+    deadlines_.reserve(reserved_);
+}
+
+size_t EventLoop::poll(std::span<Event> out) {
+    if (out.empty()) return 0;
+
+    epoll_event ready[32];
+    const int capacity = static_cast<int>(std::min(out.size(), std::size(ready)));
+
+    int count;
+    do {
+        count = epoll_wait(epoll_fd_, ready, capacity, -1);
+    } while (count < 0 && errno == EINTR);
+
+    size_t filled = 0;
+    bool rearm_needed = false;
+    for (int i = 0; i < count; ++i) {
+        if (ready[i].data.u64 == k_timer_token) {
+            uint64_t expirations;
+            [[maybe_unused]] auto _ = read(timer_fd_, &expirations, sizeof(expirations));
+            rearm_needed = true;
+            continue;
+        }
+        out[filled++] = {ready[i].data.u64, ready[i].events};
+    }
+
+    // Deadlines are checked on every wakeup, not only when the timerfd fired,
+    // so a due timer is never starved by a busy fd.
+    const auto now = Clock::now();
+    while (filled < out.size() && !deadlines_.empty() && deadlines_.front().when <= now) {
+        std::pop_heap(deadlines_.begin(), deadlines_.end(), later);
+        out[filled++] = {deadlines_.back().token, 0};
+        deadlines_.pop_back();
+        rearm_needed = true;
+    }
+    if (rearm_needed) rearm();
+
+    return filled;
+}
+
+void EventLoop::rearm() {
+    itimerspec spec{};
+    if (!deadlines_.empty()) {
+        // steady_clock is CLOCK_MONOTONIC on Linux, so the deadline can be
+        // handed to the kernel as an absolute time. A zero it_value would
+        // disarm the timer, hence the 1ns floor for already-due deadlines.
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            deadlines_.front().when.time_since_epoch())
+                            .count();
+        const auto clamped = std::max<long long>(ns, 1);
+        spec.it_value.tv_sec = clamped / 1'000'000'000;
+        spec.it_value.tv_nsec = clamped % 1'000'000'000;
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+#endif // !_WIN32
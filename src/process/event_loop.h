@@ -0,0 +1,98 @@
+#pragma once
+#ifndef _WIN32
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <sys/epoll.h>
+
+#include "util/trait.hpp"
+
+// Every fd watched by the supervisor shares one epoll set. Each registration
+// carries a 64-bit token: the high half says what kind of source it is, the
+// low half is an index whose meaning depends on the source.
+enum class Source : uint32_t {
+    TIMER,
+    SIGNAL,
+    CHILD,
+    SHUTDOWN,
+    RESTART,
+    LOG,
+    STOP_DEADLINE,
+    CONTROL,        // listening socket
+    CONTROL_CLIENT, // index is the connection slot
+    WATCH,          // inotify fd of the config watcher
+    WATCH_DUE,      // index is the watched file
+    METRICS,
+    PROBE,          // index is the health probe
+    PROBE_DUE,
+    LAUNCH,         // the launch scheduler may let the next instance spawn
+    WATCHDOG,       // systemd watchdog ping
+    NETWORK,        // rtnetlink socket of the network watcher
+    NETWORK_DUE,
+    LIMITS,         // resource watchdog sample
+    HANDOVER,       // index is the instance whose upgrade successor exited
+    HANDOVER_DUE,
+    HANDOVER_LOG,   // output pipe of the upgrade successor
+};
+
+constexpr uint64_t make_token(Source source, uint32_t index = 0) {
+    return (static_cast<uint64_t>(source) << 32) | index;
+}
+
+constexpr Source token_source(uint64_t token) {
+    return static_cast<Source>(token >> 32);
+}
+
+constexpr uint32_t token_index(uint64_t token) {
+    return static_cast<uint32_t>(token);
+}
+
+struct EventLoop : Unique {
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        uint64_t token;
+        uint32_t events;
+    };
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(EventLoop &&) = delete;
+    EventLoop &operator=(EventLoop &&) = delete;
+
+    bool is_valid() const;
+
+    bool add(int fd, uint64_t token, uint32_t events = EPOLLIN);
+    bool modify(int fd, uint64_t token, uint32_t events);
+    void remove(int fd);
+
+    // One-shot deadline backed by a single timerfd. There is no cancel: when
+    // a deadline fires its token is delivered as an event with `events == 0`
+    // and the consumer decides whether it is still relevant.
+    void schedule(Clock::time_point when, uint64_t token);
+    // Make room for `count` more pending deadlines up front, so scheduling
+    // in the steady state never allocates. Each consumer adds its share.
+    void reserve(size_t count);
+
+    // Block until something is ready and return how many entries of `out`
+    // were filled. May return 0 on a spurious timer wakeup.
+    size_t poll(std::span<Event> out);
+
+private:
+    struct Deadline {
+        Clock::time_point when;
+        uint64_t token;
+    };
+
+    void rearm();
+
+    int epoll_fd_ = -1;
+    int timer_fd_ = -1;
+    std::vector<Deadline> deadlines_; // min-heap on `when`
+    size_t reserved_ = 0;
+};
+
+#endif // !_WIN32
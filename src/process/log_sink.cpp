@@ -0,0 +1,116 @@
+#ifndef _WIN32
+
+#include "process/log_sink.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "util/print.hpp"
+
+namespace {
+
+constexpr size_t k_chunk = 64 * 1024;
+constexpr size_t k_budget = 1024 * 1024;
+
+void set_rotated_name(std::string &out, const std::string &base, int index) {
+    out.assign(base);
+    if (index > 0) {
+        out += '.';
+        out += NumStr(index);
+    }
+}
+
+} // namespace
+
+bool LogSink::open(const LogPolicy &policy) {
+    policy_ = policy;
+    from_.reserve(policy_.path.size() + 16);
+    to_.reserve(policy_.path.size() + 16);
+
+    // no O_APPEND: splice(2) refuses append-only files, so the write offset
+    // is tracked here and doubles as the size used for rotation
+    file_.reset(::open(policy_.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+    if (!file_) return false;
+
+    struct stat st;
+    offset_ = fstat(file_.get(), &st) == 0 ? st.st_size : 0;
+    if (offset_ >= policy_.max_size) rotate();
+    return true;
+}
+
+void LogSink::drain(int pipe_fd, OutputRing *ring, ReadyScanner *scanner) {
+    if (ring && ring->capacity() == 0) ring = nullptr;
+    if (scanner && scanner->matched()) scanner = nullptr;
+
+    size_t budget = k_budget;
+    while (budget > 0) {
+        size_t want = std::min(budget, k_chunk);
+        ssize_t moved;
+        iovec regions[2];
+        if (file_) {
+            // stop at the size limit so rotated files stay within it
+            want = std::min(want, static_cast<size_t>(std::max<int64_t>(policy_.max_size - offset_, 1)));
+            moved = splice(pipe_fd, nullptr, file_.get(), &offset_, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved > 0 && ring) {
+                // copy back the tail of what just landed in the page cache
+                const size_t keep = std::min(static_cast<size_t>(moved), ring->capacity());
+                const int count = ring->reserve(keep, regions);
+                const auto got = preadv(file_.get(), regions, count, offset_ - static_cast<loff_t>(keep));
+                if (got > 0) ring->commit(static_cast<size_t>(got));
+            }
+            if (moved > 0 && scanner) {
+                // only until the instance is ready, read back from the page cache
+                char chunk[4096];
+                for (loff_t at = offset_ - moved; at < offset_ && !scanner->matched();) {
+                    const auto got = pread(file_.get(), chunk, std::min<loff_t>(sizeof(chunk), offset_ - at), at);
+                    if (got <= 0) break;
+                    scanner->feed({chunk, static_cast<size_t>(got)});
+                    at += got;
+                }
+            }
+        } else if (ring) {
+            // the log file could not be opened: read straight into the ring
+            // so the child never blocks on a full pipe
+            const int count = ring->reserve(want, regions);
+            moved = readv(pipe_fd, regions, count);
+            if (moved > 0) {
+                ring->commit(static_cast<size_t>(moved));
+                if (scanner) {
+                    const size_t first = std::min(static_cast<size_t>(moved), regions[0].iov_len);
+                    scanner->feed({static_cast<const char *>(regions[0].iov_base), first});
+                    scanner->feed({static_cast<const char *>(regions[1].iov_base), static_cast<size_t>(moved) - first});
+                }
+            }
+        } else {
+            char discard[4096];
+            moved = read(pipe_fd, discard, std::min(want, sizeof(discard)));
+            if (moved > 0 && scanner) scanner->feed({discard, static_cast<size_t>(moved)});
+        }
+        if (moved <= 0) break;
+
+        budget -= static_cast<size_t>(moved);
+        if (file_ && offset_ >= policy_.max_size) rotate();
+    }
+}
+
+void LogSink::rotate() {
+    if (policy_.max_files <= 1) {
+        ftruncate(file_.get(), 0);
+        offset_ = 0;
+        return;
+    }
+
+    // app.log.(n-2) -> app.log.(n-1), ..., app.log -> app.log.1
+    for (int i = policy_.max_files - 1; i > 0; --i) {
+        set_rotated_name(from_, policy_.path, i - 1);
+        set_rotated_name(to_, policy_.path, i);
+        std::rename(from_.c_str(), to_.c_str());
+    }
+
+    file_.reset(::open(policy_.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    offset_ = 0;
+}
+
+#endif // !_WIN32
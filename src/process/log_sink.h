@@ -0,0 +1,46 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#include "process/output_ring.h"
+#include "process/ready_scanner.h"
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+struct LogPolicy {
+    std::string path; // empty: the child keeps the supervisor's stdout/stderr
+    int64_t max_size = 10 * 1024 * 1024;
+    int max_files = 5; // including the active one
+    size_t ring_size = 16 * 1024; // recent output kept in memory, 0 disables
+
+    bool operator==(const LogPolicy &) const = default;
+};
+
+// Size-rotated log file fed from a child's output pipe with splice(2), so
+// the bytes go from the pipe into the page cache without ever being copied
+// through the supervisor.
+struct LogSink : Unique {
+    bool open(const LogPolicy &policy);
+    bool is_open() const { return static_cast<bool>(file_); }
+    const LogPolicy &policy() const { return policy_; }
+
+    // Move what is buffered in `pipe_fd` into the file. Bounded per call so a
+    // chatty instance cannot starve the others sharing the event loop. The
+    // tail of what was moved is also copied into `ring` when given, and
+    // everything is fed to `scanner` until it has matched.
+    void drain(int pipe_fd, OutputRing *ring, ReadyScanner *scanner = nullptr);
+
+private:
+    void rotate();
+
+    LogPolicy policy_;
+    UniqueFd file_;
+    loff_t offset_ = 0;
+    std::string from_; // rename scratch buffers, reserved once in open()
+    std::string to_;
+};
+
+#endif // !_WIN32
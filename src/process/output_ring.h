@@ -0,0 +1,58 @@
+#pragma once
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <sys/uio.h>
+
+#include "util/trait.hpp"
+
+// Fixed-capacity byte ring holding the most recent output of one instance.
+// Storage is allocated once in allocate(); afterwards writes only overwrite
+// the oldest bytes, so memory stays bounded no matter how chatty frpc is.
+struct OutputRing : Unique {
+    void allocate(size_t capacity) {
+        data_ = std::make_unique<char[]>(capacity);
+        capacity_ = capacity;
+        clear();
+    }
+
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+    void clear() { head_ = size_ = 0; }
+
+    // Describe where the next `n` bytes (at most capacity()) go, as up to two
+    // regions for readv/preadv. Call commit() with what was actually filled.
+    int reserve(size_t n, iovec (&out)[2]) const {
+        n = std::min(n, capacity_);
+        const size_t first = std::min(n, capacity_ - head_);
+        out[0] = {data_.get() + head_, first};
+        out[1] = {data_.get(), n - first};
+        return n > first ? 2 : 1;
+    }
+
+    void commit(size_t n) {
+        head_ = (head_ + n) % capacity_;
+        size_ = std::min(size_ + n, capacity_);
+    }
+
+    // contents oldest first, split where the ring wraps
+    std::pair<std::string_view, std::string_view> contents() const {
+        const size_t tail = (head_ + capacity_ - size_) % capacity_;
+        if (tail + size_ <= capacity_) {
+            return {{data_.get() + tail, size_}, {}};
+        }
+        return {{data_.get() + tail, capacity_ - tail}, {data_.get(), head_}};
+    }
+
+private:
+    std::unique_ptr<char[]> data_;
+    size_t capacity_ = 0;
+    size_t head_ = 0; // next write position
+    size_t size_ = 0;
+};
+
+#endif // !_WIN32
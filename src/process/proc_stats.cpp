@@ -0,0 +1,106 @@
+#ifndef _WIN32
+
+#include "process/proc_stats.h"
+
+#include <charconv>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const long k_page_size = sysconf(_SC_PAGESIZE);
+const long k_clock_ticks = sysconf(_SC_CLK_TCK);
+
+int open_proc(int pid, const char *name, int flags) {
+    char path[48];
+    std::snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return ::open(path, flags | O_CLOEXEC);
+}
+
+// the `index`-th space separated number of `text`, 0 if there is none
+int64_t field(std::string_view text, int index) {
+    for (; index > 0; --index) {
+        const auto space = text.find(' ');
+        if (space == std::string_view::npos) return 0;
+        text.remove_prefix(space + 1);
+    }
+    int64_t value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+} // namespace
+
+bool ProcSampler::open(int pid) {
+    close();
+    stat_.reset(open_proc(pid, "stat", O_RDONLY));
+    statm_.reset(open_proc(pid, "statm", O_RDONLY));
+    fd_dir_.reset(open_proc(pid, "fd", O_RDONLY | O_DIRECTORY));
+    if (!stat_ || !statm_) {
+        close();
+        return false;
+    }
+    pid_ = pid;
+    return true;
+}
+
+void ProcSampler::close() {
+    stat_.reset();
+    statm_.reset();
+    fd_dir_.reset();
+    pid_ = -1;
+}
+
+bool ProcSampler::sample(ProcStats &out) {
+    if (pid_ < 0) return false;
+
+    char buffer[512];
+    auto got = pread(stat_.get(), buffer, sizeof(buffer) - 1, 0);
+    if (got <= 0) return false;
+    std::string_view stat(buffer, static_cast<size_t>(got));
+    // comm may contain spaces and parens, the fields start after the last ')'
+    const auto comm_end = stat.rfind(')');
+    if (comm_end == std::string_view::npos || comm_end + 2 > stat.size()) return false;
+    stat.remove_prefix(comm_end + 2);
+    // indices relative to field 3 (state) of proc_pid_stat(5)
+    const auto ticks = field(stat, 11) + field(stat, 12);
+    out.cpu_ms = ticks * 1000 / k_clock_ticks;
+    out.threads = static_cast<int>(field(stat, 17));
+
+    got = pread(statm_.get(), buffer, sizeof(buffer) - 1, 0);
+    if (got <= 0) return false;
+    out.rss_bytes = field({buffer, static_cast<size_t>(got)}, 1) * k_page_size;
+
+    out.fds = count_fds();
+    return true;
+}
+
+int ProcSampler::count_fds() {
+    if (!fd_dir_) return 0;
+    // since Linux 6.2 the size of /proc/<pid>/fd is the number of open fds
+    struct stat st;
+    if (fstat(fd_dir_.get(), &st) == 0 && st.st_size > 0) {
+        return static_cast<int>(st.st_size);
+    }
+
+    // older kernels: walk the directory, still without reopening it
+    lseek(fd_dir_.get(), 0, SEEK_SET);
+    alignas(dirent64) char entries[4096];
+    int count = 0;
+    long got;
+    while ((got = syscall(SYS_getdents64, fd_dir_.get(), entries, sizeof(entries))) > 0) {
+        for (long offset = 0; offset < got;) {
+            const auto *entry = reinterpret_cast<const dirent64 *>(entries + offset);
+            offset += entry->d_reclen;
+            if (entry->d_name[0] != '.') count += 1;
+        }
+    }
+    return count;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+
+#include "util/trait.hpp"
+#include "util/unique_fd.hpp"
+
+// resource usage of one child, as last sampled
+struct ProcStats {
+    int64_t rss_bytes = 0;
+    int64_t cpu_ms = 0; // user + system
+    int fds = 0;
+    int threads = 0;
+    // the instance's whole cgroup, anything frpc forked included; 0 without
+    int64_t cgroup_memory_bytes = 0;
+    int64_t cgroup_cpu_ms = 0;
+};
+
+// Keeps /proc/<pid>/stat, statm and fd open for one child so a sample is a
+// couple of pread(2) and one fstat(2), with no path lookups or opens.
+struct ProcSampler : Unique {
+    bool open(int pid);
+    void close();
+    int pid() const { return pid_; }
+
+    // false once the process is gone
+    bool sample(ProcStats &out);
+
+private:
+    int count_fds();
+
+    int pid_ = -1;
+    UniqueFd stat_;
+    UniqueFd statm_;
+    UniqueFd fd_dir_;
+};
+
+#endif // !_WIN32
@@ -1,9 +1,54 @@
 #pragma once
 
 #include <span>
+#include <string>
+#include <string_view>
 
 #include "util/pimpl.hpp"
 
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+// Resolve `name` against PATH the way execvp would, so it is done once per
+// binary instead of on every spawn. Names containing a slash are returned as is.
+std::string find_executable(std::string_view name);
+
+#ifndef _WIN32
+// Scheduling knobs of one instance, applied best effort in the child right
+// before exec. The defaults inherit the supervisor's settings.
+struct SchedOptions {
+    bool pin = false;
+    cpu_set_t cpus{};
+    int numa_node = -1; // preferred memory node
+    bool renice = false;
+    int nice = 0;
+    int io_class = 0; // IOPRIO_CLASS_RT/BE/IDLE (1..3), 0 keeps
+    int io_level = 4; // 0 (highest) ..7
+    int policy = -1;  // SCHED_BATCH or SCHED_IDLE
+};
+#endif
+
+// Per-spawn setup applied in the child before exec (unix only for now).
+struct SpawnOptions {
+    // redirect the child's stdout/stderr, -1 keeps the supervisor's
+    int stdout_fd = -1;
+    int stderr_fd = -1;
+    // cgroup v2 directory to spawn the child into (linux), -1 inherits ours
+    int cgroup_fd = -1;
+#ifndef _WIN32
+    const SchedOptions *sched = nullptr;
+    // passed on as k_config_fd, for a config that only exists in memory
+    int config_fd = -1;
+#endif
+};
+
+#ifndef _WIN32
+// the child finds SpawnOptions::config_fd here, and opens it by this path
+constexpr int k_config_fd = 3;
+constexpr const char *k_config_fd_path = "/proc/self/fd/3";
+#endif
+
 struct Process : Pimpl<Process> {
     struct Impl;
 
@@ -13,9 +58,28 @@ struct Process : Pimpl<Process> {
     Process(Process &&) noexcept = default;
     Process &operator=(Process &&) noexcept = default;
 
-    bool start(std::span<const char *const> args);
+    bool start(std::span<const char *const> args, const SpawnOptions &options = {});
     bool stop(int timeout_ms = 5000);
     bool is_running() const;
     int wait();
     bool is_valid() const;
+
+#ifndef _WIN32
+    // Handles for event-driven supervision. `pidfd()` is -1 on kernels
+    // without pidfd_open (pre 5.3); SIGCHLD has to drive reaping then.
+    int pid() const;
+    int pidfd() const;
+
+    bool signal(int sig);
+
+    // Non-blocking reap, returns true once the child has been collected.
+    bool try_wait();
+    int exit_code() const;
+    int term_signal() const;
+
+    // Take over a child this process already owns (a supervisor re-exec
+    // inherits its children and their pidfds). `pidfd` may be -1, one is
+    // opened then if the kernel allows.
+    void adopt(int pid, int pidfd);
+#endif
 };
@@ -1,34 +1,1334 @@
 #include "process/process_manager.h"
 
-#include <charconv>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <cmath>
+#include <csignal>
+#include "process/trace.h"
 #include "util/print.hpp"
 
-bool ProcessManager::add_process(std::span<const char *const> args) {
-    Process process;
-    if (!process.start(args)) {
-        return false;
+#ifndef _WIN32
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char *state_name(InstanceState state) {
+    switch (state) {
+        case InstanceState::RUNNING: return "running";
+        case InstanceState::BACKOFF: return "backoff";
+        case InstanceState::STOPPED: return "stopped";
+        case InstanceState::PARKED: return "parked";
+        case InstanceState::REMOVED: return "removed";
+        case InstanceState::QUEUED: return "queued";
+    }
+    return "unknown";
+}
+
+void ProcessManager::reserve(size_t count) {
+    processes_.reserve(count);
+    states_.reserve(count);
+    name_hashes_.reserve(count);
+#ifndef _WIN32
+    starting_since_.reserve(count);
+    free_slots_.reserve(count);
+    launch_queue_.reserve(count);
+#endif
+}
+
+uint64_t ProcessManager::hash_name(std::string_view name) {
+    return std::hash<std::string_view>{}(name);
+}
+
+uint32_t ProcessManager::add_process(std::string_view name, std::span<const std::string> args,
+                                     const InstanceOptions &options) {
+    Entry entry;
+    entry.name = name;
+    entry.policy = options.restart;
+    set_args(entry, args);
+#ifndef _WIN32
+    open_output(entry, options.log);
+    if (const auto &limits = options.cgroup; limits && cgroups_.is_ready()) {
+        entry.cgroup.create(cgroups_, entry.name, *limits);
+    }
+    entry.sched = options.sched;
+    entry.rendered = options.rendered;
+    entry.bucket = bucket_of(options.server);
+    entry.ready_from = options.log.path.empty() && options.ready_from == ReadySource::OUTPUT ? ReadySource::SPAWN
+                                                                                              : options.ready_from;
+
+    // reuse the slot of an instance a reload dropped, so repeated reloads do
+    // not grow the table. Its old tokens are harmless: the pidfd is closed
+    // and stale deadlines are checked against the new entry's state.
+    if (!free_slots_.empty()) {
+        const auto i = free_slots_.back();
+        free_slots_.pop_back();
+        processes_[i] = std::move(entry);
+        set_state(i, InstanceState::STOPPED);
+        name_hashes_[i] = hash_name(name);
+        set_starting(i, {});
+        if (loop_ && processes_[i].output_read) {
+            loop_->add(processes_[i].output_read.get(), make_token(Source::LOG, i));
+        }
+        return i;
+    }
+#endif
+
+    const auto index = static_cast<uint32_t>(processes_.size());
+    processes_.push_back(std::move(entry));
+    states_.push_back(InstanceState::STOPPED);
+    name_hashes_.push_back(hash_name(name));
+    changes_ += 1;
+#ifndef _WIN32
+    starting_since_.emplace_back();
+    if (loop_) {
+        loop_->reserve(3);
+        if (processes_[index].output_read) {
+            loop_->add(processes_[index].output_read.get(), make_token(Source::LOG, index));
+        }
+    }
+#endif
+    return index;
+}
+
+void ProcessManager::set_state(uint32_t index, InstanceState state) {
+    states_[index] = state;
+    changes_ += 1;
+}
+
+void ProcessManager::set_args(Entry &entry, std::span<const std::string> args) {
+    // keep our own copy of argv around so the instance can be respawned
+    entry.arg_storage.assign(args.begin(), args.end());
+    entry.args.clear();
+    for (const auto &arg : entry.arg_storage) {
+        entry.args.push_back(arg.c_str());
+    }
+#ifndef _WIN32
+    entry.args.push_back(nullptr);
+#endif
+}
+
+SpawnOptions ProcessManager::spawn_options(const Entry &entry) const {
+    SpawnOptions options;
+#ifndef _WIN32
+    options.stdout_fd = entry.output_write.get();
+    options.stderr_fd = entry.output_write.get();
+    if (entry.cgroup) options.cgroup_fd = entry.cgroup.fd();
+    options.sched = &entry.sched;
+    if (entry.rendered) options.config_fd = entry.rendered->fd.get();
+#endif
+    return options;
+}
+
+bool ProcessManager::start_all() {
+    using namespace std::chrono;
+    const auto begin = steady_clock::now();
+
+#ifndef _WIN32
+    // paced: everything is queued and launched from the loop once watch()
+    // attaches it
+    if (launch_.limited()) {
+        for (uint32_t i = 0; i < processes_.size(); ++i) {
+            if (states_[i] != InstanceState::STOPPED || processes_[i].resumed) continue;
+            set_state(i, InstanceState::QUEUED);
+            tracer().record(TraceKind::QUEUED, processes_[i].name);
+            processes_[i].launch_restart = false;
+            launch_queue_.push_back(i);
+            active_ += 1;
+        }
+        batch_started_ = EventLoop::Clock::now();
+        print("Queued ", NumStr(static_cast<long long>(launch_queue_.size())), " frpc instance(s) for a paced launch\n");
+        return true;
     }
+#endif
 
-    processes_.push_back(std::move(process));
+    size_t started = 0;
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+#ifndef _WIN32
+        // still running from before a re-exec, or meant to stay down
+        if (processes_[i].resumed) continue;
+#endif
+        if (states_[i] != InstanceState::STOPPED) continue;
+        auto &entry = processes_[i];
+        const auto spawning = TraceRing::Clock::now();
+        if (!entry.process.start(entry.args, spawn_options(entry))) {
+            print("Failed to start frpc with config: ", entry.name, "\n");
+#ifndef _WIN32
+            // the children taken over from before a re-exec keep running
+            if (resumed_) {
+                print("Instance ", entry.name, " stays stopped, start it through the control socket\n");
+                continue;
+            }
+#endif
+            return false;
+        }
+        set_state(i, InstanceState::RUNNING);
+#ifndef _WIN32
+        entry.started_at = EventLoop::Clock::now();
+        set_starting(i, entry.started_at);
+        tracer().record_span(TraceKind::SPAWN, entry.name, spawning, entry.started_at, entry.process.pid());
+#else
+        tracer().record_span(TraceKind::SPAWN, entry.name, spawning, TraceRing::Clock::now());
+#endif
+        active_ += 1;
+        started += 1;
+    }
+#ifndef _WIN32
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (processes_[i].ready_from == ReadySource::SPAWN) mark_ready(i);
+    }
+#endif
+
+    const auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+#ifndef _WIN32
+        if (processes_[i].resumed) continue;
+#endif
+        if (states_[i] == InstanceState::RUNNING) print("Started frpc with config: ", processes_[i].name, "\n");
+    }
+    print("Started ", NumStr(static_cast<long long>(started)), " frpc instance(s) in ", NumStr(elapsed.count()),
+          " us\n");
     return true;
 }
 
-void ProcessManager::terminate_all() {
-    for (auto &process : processes_) {
-        process.stop();
+void ProcessManager::terminate_all(int timeout_ms) {
+#ifndef _WIN32
+    // no event loop to wait on here, but still SIGTERM everyone before
+    // waiting, so this takes as long as the slowest child and not the sum
+    for (auto &entry : processes_) {
+        if (entry.process.signal(SIGTERM)) tracer().record(TraceKind::SIGNAL, entry.name, SIGTERM);
     }
+    const auto deadline = EventLoop::Clock::now() + std::chrono::milliseconds(timeout_ms);
+    const auto all_exited = [this] {
+        return std::ranges::all_of(processes_, [](Entry &entry) {
+            return !entry.process.is_valid() || entry.process.try_wait();
+        });
+    };
+    while (!all_exited() && EventLoop::Clock::now() < deadline) {
+        usleep(10000);
+    }
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (processes_[i].process.is_running() && force_kill(i)) {
+            print("Process ", processes_[i].name, " did not exit in time, sent SIGKILL\n");
+        }
+        processes_[i].process.wait();
+    }
+#else
+    for (auto &entry : processes_) {
+        entry.process.stop(timeout_ms);
+    }
+#endif
 }
 
 void ProcessManager::wait_all() {
-    for (auto &process : processes_) {
-        int exit_code = process.wait();
-        char buffer[11]; // enough for 32-bit int
-        if (auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), exit_code); ec == std::errc()) {
-            *ptr = '\0';
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+#ifndef _WIN32
+        // an upgrade successor killed by the shutdown, not reaped in time
+        if (processes_[i].successor.is_running()) processes_[i].successor.wait();
+#endif
+        if (states_[i] != InstanceState::RUNNING) continue;
+        auto &entry = processes_[i];
+        entry.process.wait();
+        set_state(i, InstanceState::STOPPED);
+        active_ -= 1;
+        report(entry);
+    }
+}
+
+void ProcessManager::report(Entry &entry) {
+#ifndef _WIN32
+    if (const int sig = entry.process.term_signal(); sig != 0) {
+        print("Process ", entry.name, " killed by signal: ", NumStr(sig), "\n");
+    } else {
+        print("Process ", entry.name, " exited with code: ", NumStr(entry.process.exit_code()), "\n");
+    }
+
+    if (shutting_down()) {
+        using namespace std::chrono;
+        const auto elapsed = duration_cast<milliseconds>(EventLoop::Clock::now() - shutdown_started_);
+        print("Process ", entry.name, " stopped in ", NumStr(elapsed.count()), " ms\n");
+        if (active_ == 0) {
+            print("Shutdown completed in ", NumStr(elapsed.count()), " ms\n");
+        }
+    }
+#else
+    print("Process ", entry.name, " exited with code: ", NumStr(entry.process.wait()), "\n");
+#endif
+}
+
+#ifndef _WIN32
+
+namespace {
+
+bool wants_restart(RestartMode mode, bool failed) {
+    switch (mode) {
+        case RestartMode::ALWAYS: return true;
+        case RestartMode::ON_FAILURE: return failed;
+        case RestartMode::NEVER: return false;
+    }
+    return false;
+}
+
+} // namespace
+
+void ProcessManager::watch(EventLoop &loop) {
+    loop_ = &loop;
+    // a stop deadline may still be pending when the restart or a handover
+    // one is added, plus the shared shutdown deadline and a few launch ones
+    loop.reserve(processes_.size() * 3 + 4);
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (const int fd = processes_[i].process.pidfd(); fd >= 0) {
+            loop.add(fd, make_token(Source::CHILD, i));
+        }
+        if (processes_[i].output_read) {
+            loop.add(processes_[i].output_read.get(), make_token(Source::LOG, i));
+        }
+        // a backoff taken over from before a re-exec needs its timer again
+        if (std::exchange(processes_[i].resumed, false) && states_[i] == InstanceState::BACKOFF) {
+            loop.schedule(processes_[i].restart_at, make_token(Source::RESTART, i));
+        }
+    }
+    launch_queue_.reserve(processes_.capacity());
+    pump_launches();
+}
+
+void ProcessManager::open_output(Entry &entry, const LogPolicy &policy) {
+    if (policy.path.empty()) return;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        print("Failed to create output pipe for: ", entry.name, "\n");
+        return;
+    }
+    entry.output_read.reset(fds[0]);
+    entry.output_write.reset(fds[1]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    if (policy.ring_size > 0) {
+        entry.recent_output.allocate(policy.ring_size);
+    }
+    if (!entry.log.open(policy)) {
+        print("Failed to open log file: ", policy.path, "\n");
+    }
+}
+
+bool ProcessManager::enable_cgroups() {
+    return cgroups_.is_ready() || cgroups_.init();
+}
+
+void ProcessManager::place_in_cgroup(uint32_t index, const std::optional<CgroupLimits> &limits) {
+    auto &entry = processes_[index];
+    if (!limits) {
+        // an occupied cgroup cannot be removed, it only loses its limits
+        if (states_[index] == InstanceState::RUNNING) {
+            if (cgroups_.has_controllers() && entry.cgroup.limits() != CgroupLimits{}) entry.cgroup.apply({});
+        } else if (entry.cgroup) {
+            entry.cgroup.destroy();
+        }
+    } else if (entry.cgroup) {
+        // written only when they changed, unchanged instances cost no syscalls
+        if (cgroups_.has_controllers() && entry.cgroup.limits() != *limits) entry.cgroup.apply(*limits);
+    } else if (cgroups_.is_ready()) {
+        entry.cgroup.create(cgroups_, entry.name, *limits);
+    }
+}
+
+// SIGKILL the instance, through its cgroup when it has one so nothing it
+// forked survives
+bool ProcessManager::force_kill(uint32_t index) {
+    if (states_[index] != InstanceState::RUNNING) return false;
+    auto &entry = processes_[index];
+    tracer().record(TraceKind::SIGNAL, entry.name, SIGKILL);
+    // during a handover the successor lives in the same cgroup
+    const bool shared = entry.handover == Handover::STARTING || entry.handover == Handover::SWITCHING;
+    return (!shared && entry.cgroup.kill()) || entry.process.signal(SIGKILL);
+}
+
+void ProcessManager::on_log_event(uint32_t index) {
+    if (index >= processes_.size()) return;
+    auto &entry = processes_[index];
+    const bool scan = states_[index] == InstanceState::RUNNING && entry.ready_from == ReadySource::OUTPUT && !entry.ready;
+    entry.log.drain(entry.output_read.get(), &entry.recent_output, scan ? &entry.scanner : nullptr);
+    if (scan && entry.scanner.matched()) mark_ready(index);
+}
+
+void ProcessManager::mark_ready(uint32_t index) {
+    using namespace std::chrono;
+    if (index >= processes_.size()) return;
+    auto &entry = processes_[index];
+    if (states_[index] != InstanceState::RUNNING || entry.ready) return;
+    entry.ready = true;
+    changes_ += 1;
+    entry.ready_ms = duration_cast<milliseconds>(EventLoop::Clock::now() - entry.started_at).count();
+    ready_ += 1;
+    tracer().record(TraceKind::READY, entry.name);
+    if (entry.ready_from != ReadySource::SPAWN) {
+        print("Process ", entry.name, " ready in ", NumStr(entry.ready_ms), " ms\n");
+        // it no longer holds a launch slot
+        set_starting(index, {});
+        if (!launch_queue_.empty()) pump_launches();
+    }
+}
+
+void ProcessManager::clear_ready(Entry &entry) {
+    if (entry.ready) {
+        ready_ -= 1;
+        changes_ += 1;
+    }
+    entry.ready = false;
+    entry.scanner.reset();
+}
+
+bool ProcessManager::starting(uint32_t index, EventLoop::Clock::time_point now) const {
+    const auto since = starting_since_[index];
+    return since != EventLoop::Clock::time_point{} && now < since + std::chrono::milliseconds(launch_.settle_ms);
+}
+
+void ProcessManager::set_starting(uint32_t index, EventLoop::Clock::time_point since) {
+    constexpr EventLoop::Clock::time_point none{};
+    if (starting_since_[index] != none) starting_ -= 1;
+    if (since != none) starting_ += 1;
+    starting_since_[index] = since;
+}
+
+void ProcessManager::sample_usage() {
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (states_[i] != InstanceState::RUNNING) continue;
+        auto &entry = processes_[i];
+        // opened once per spawn, every later sample reuses the descriptors
+        const int pid = entry.process.pid();
+        if (entry.sampler.pid() == pid || entry.sampler.open(pid)) {
+            entry.sampler.sample(entry.usage);
+        }
+        int64_t cpu_usec = 0;
+        if (entry.cgroup && entry.cgroup.sample(entry.usage.cgroup_memory_bytes, cpu_usec)) {
+            entry.usage.cgroup_cpu_ms = cpu_usec / 1000;
+        }
+    }
+}
+
+void ProcessManager::dump_output() {
+    for (const auto &entry : processes_) {
+        dump_output(entry);
+    }
+}
+
+void ProcessManager::dump_output(const Entry &entry) {
+    if (entry.recent_output.empty()) return;
+    const auto [older, newer] = entry.recent_output.contents();
+    const auto last = newer.empty() ? older : newer;
+    print("---- recent output of ", entry.name, " ----\n", older, newer,
+          last.ends_with('\n') ? "" : "\n", "---- end of output ----\n");
+}
+
+void ProcessManager::on_child_event(uint32_t index) {
+    if (index >= processes_.size()) return;
+    if (states_[index] == InstanceState::RUNNING && processes_[index].process.try_wait()) {
+        on_exit(index);
+    }
+}
+
+void ProcessManager::on_sigchld() {
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (states_[i] != InstanceState::RUNNING) continue;
+        auto &entry = processes_[i];
+        if (entry.process.pidfd() < 0 && entry.process.try_wait()) {
+            on_exit(i);
+        }
+    }
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        const auto &successor = processes_[i].successor;
+        if (successor.is_valid() && successor.pidfd() < 0) on_handover_event(i);
+    }
+}
+
+void ProcessManager::on_exit(uint32_t index) {
+    auto &entry = processes_[index];
+    // flush the last words of the child before reporting its exit
+    if (entry.output_read) entry.log.drain(entry.output_read.get(), &entry.recent_output);
+
+    entry.last_exit_code = entry.process.exit_code();
+    entry.last_signal = entry.process.term_signal();
+    tracer().record(TraceKind::EXIT, entry.name, entry.last_signal != 0 ? -entry.last_signal : entry.last_exit_code);
+    if (entry.pending == PendingAction::HANDOVER && !shutting_down()) {
+        complete_handover(index);
+        return;
+    }
+    if (entry.handover == Handover::STARTING) fail_handover(index, "the running child exited");
+    clear_ready(entry);
+    set_starting(index, {});
+    entry.sampler.close();
+    entry.usage = {};
+    // frpc is gone, whatever it left behind in its cgroup goes too
+    if (entry.cgroup) entry.cgroup.kill();
+    const auto pending = std::exchange(entry.pending, PendingAction::NONE);
+    const bool failed = entry.last_signal != 0 || entry.last_exit_code != 0;
+    const bool requested = pending != PendingAction::NONE;
+    const bool restart = !shutting_down() && !requested && wants_restart(entry.policy.mode, failed);
+    const bool respawn_now = !shutting_down() && pending == PendingAction::RESTART;
+    if (!restart && !respawn_now) {
+        set_state(index, InstanceState::STOPPED);
+        active_ -= 1;
+    }
+
+    report(entry);
+    if (failed && !requested && !shutting_down()) dump_output(entry);
+    if (restart) {
+        schedule_restart(index, EventLoop::Clock::now());
+    } else if (respawn_now) {
+        launch(index);
+    } else if (pending == PendingAction::REMOVE) {
+        retire(index);
+    }
+    // an instance that was still starting frees its launch slot
+    if (!launch_queue_.empty()) pump_launches();
+}
+
+void ProcessManager::schedule_restart(uint32_t index, EventLoop::Clock::time_point now) {
+    using namespace std::chrono;
+    auto &entry = processes_[index];
+    const auto &policy = entry.policy;
+    const auto window = milliseconds(policy.window_ms);
+
+    // a run that outlived the crash window counts as healthy again
+    if (now - entry.started_at >= window) {
+        entry.consecutive_failures = 0;
+    }
+    if (now - entry.window_start >= window) {
+        entry.window_start = now;
+        entry.window_restarts = 0;
+    }
+
+    if (entry.window_restarts >= policy.max_restarts) {
+        set_state(index, InstanceState::PARKED);
+        tracer().record(TraceKind::PARKED, entry.name);
+        active_ -= 1;
+        print("Process ", entry.name, " is crash looping (", NumStr(entry.window_restarts),
+              " restarts within ", NumStr(policy.window_ms / 1000), " s), parked\n");
+        return;
+    }
+    entry.window_restarts += 1;
+
+    const int shift = std::min(entry.consecutive_failures, 30);
+    entry.consecutive_failures += 1;
+    double delay = std::min(std::ldexp(static_cast<double>(policy.initial_backoff_ms), shift),
+                            static_cast<double>(policy.max_backoff_ms));
+    if (policy.jitter > 0) {
+        std::uniform_real_distribution<double> spread(-policy.jitter, policy.jitter);
+        delay *= 1.0 + spread(rng_);
+    }
+    const auto delay_ms = static_cast<long long>(std::max(delay, 0.0));
+
+    set_state(index, InstanceState::BACKOFF);
+    entry.restart_at = now + milliseconds(delay_ms);
+    loop_->schedule(entry.restart_at, make_token(Source::RESTART, index));
+    tracer().record(TraceKind::BACKOFF, entry.name, static_cast<int32_t>(delay_ms));
+    print("Process ", entry.name, " will be restarted in ", NumStr(delay_ms), " ms\n");
+}
+
+void ProcessManager::on_restart_due(uint32_t index) {
+    if (index >= processes_.size()) return;
+    // stale deadline, or the instance was stopped meanwhile
+    if (states_[index] != InstanceState::BACKOFF || EventLoop::Clock::now() < processes_[index].restart_at) return;
+    launch(index);
+}
+
+void ProcessManager::set_launch_policy(const LaunchPolicy &policy) {
+    launch_ = policy;
+    for (auto &bucket : buckets_) {
+        bucket.tokens = std::min(bucket.tokens, static_cast<double>(policy.server_burst));
+    }
+    if (loop_ && !launch_queue_.empty()) pump_launches();
+}
+
+uint32_t ProcessManager::bucket_of(std::string_view server) {
+    for (uint32_t i = 0; i < buckets_.size(); ++i) {
+        if (buckets_[i].server == server) return i;
+    }
+    // a new server starts with a full bucket
+    buckets_.push_back({std::string(server), static_cast<double>(std::max(launch_.server_burst, 1)),
+                        EventLoop::Clock::now()});
+    return static_cast<uint32_t>(buckets_.size() - 1);
+}
+
+void ProcessManager::launch(uint32_t index, bool restart) {
+    auto &entry = processes_[index];
+    if (!launch_.limited() || !loop_) {
+        respawn(index, restart);
+        return;
+    }
+    set_state(index, InstanceState::QUEUED);
+    tracer().record(TraceKind::QUEUED, entry.name);
+    entry.launch_restart = restart;
+    launch_queue_.push_back(index);
+    pump_launches();
+}
+
+void ProcessManager::dequeue(uint32_t index) {
+    for (size_t position = 0; position < launch_queue_.size(); ++position) {
+        if (launch_queue_[position] != index) continue;
+        launch_queue_.erase(position);
+        return;
+    }
+}
+
+void ProcessManager::LaunchQueue::reserve(size_t capacity) {
+    if (capacity <= ring_.size()) return;
+    std::vector<uint32_t> ring(capacity);
+    for (size_t position = 0; position < size_; ++position) {
+        ring[position] = (*this)[position];
+    }
+    ring_ = std::move(ring);
+    head_ = 0;
+}
+
+void ProcessManager::LaunchQueue::push_back(uint32_t index) {
+    // an instance is queued at most once, so only a reload growing the
+    // table past its capacity gets here with a full ring
+    if (size_ == ring_.size()) reserve(std::max<size_t>(ring_.size() * 2, 16));
+    ring_[(head_ + size_) % ring_.size()] = index;
+    size_ += 1;
+}
+
+void ProcessManager::LaunchQueue::erase(size_t position) {
+    if (position == 0) {
+        head_ = (head_ + 1) % ring_.size();
+    } else {
+        for (; position + 1 < size_; ++position) {
+            ring_[(head_ + position) % ring_.size()] = (*this)[position + 1];
+        }
+    }
+    size_ -= 1;
+}
+
+void ProcessManager::on_launch_due() {
+    if (EventLoop::Clock::now() >= launch_due_) launch_due_ = {};
+    pump_launches();
+}
+
+// Spawn queued instances in order for as long as the policy allows, then
+// arm one Source::LAUNCH deadline for the moment the blocking limit lifts: the
+// end of the stagger gap, the first starting instance settling, or the next
+// token of a server someone is waiting for.
+void ProcessManager::pump_launches() {
+    using namespace std::chrono;
+    if (!loop_ || shutting_down()) return;
+    const auto now = EventLoop::Clock::now();
+    const auto rate = launch_.server_rate;
+    const auto burst = static_cast<double>(std::max(launch_.server_burst, 1));
+    auto wake = EventLoop::Clock::time_point::max();
+
+    while (!launch_queue_.empty()) {
+        if (now < next_launch_) {
+            wake = next_launch_;
+            break;
+        }
+        // the running count only over-counts instances that settled without
+        // becoming ready, so the table is swept just when it says full
+        const auto limit = static_cast<size_t>(std::max(launch_.max_starting, 0));
+        if (limit > 0 && starting_ >= limit) {
+            auto settles = EventLoop::Clock::time_point::max();
+            for (uint32_t i = 0; i < starting_since_.size(); ++i) {
+                if (starting_since_[i] == EventLoop::Clock::time_point{}) continue;
+                if (!starting(i, now)) {
+                    set_starting(i, {});
+                    continue;
+                }
+                settles = std::min(settles, starting_since_[i] + milliseconds(launch_.settle_ms));
+            }
+            if (starting_ >= limit) {
+                wake = settles;
+                break;
+            }
+        }
+
+        // the first queued instance whose server has a token to spare;
+        // others stay ahead in the queue when only their server is busy
+        auto chosen = launch_queue_.size();
+        for (size_t position = 0; position < launch_queue_.size(); ++position) {
+            auto &bucket = buckets_[processes_[launch_queue_[position]].bucket];
+            if (rate <= 0) {
+                chosen = position;
+                break;
+            }
+            const double elapsed = duration<double>(now - bucket.refilled).count();
+            bucket.tokens = std::min(burst, bucket.tokens + elapsed * rate);
+            bucket.refilled = now;
+            if (bucket.tokens >= 1) {
+                chosen = position;
+                break;
+            }
+            const auto refill = now + duration_cast<EventLoop::Clock::duration>(duration<double>((1 - bucket.tokens) / rate));
+            wake = std::min(wake, refill);
+        }
+        if (chosen == launch_queue_.size()) break;
+
+        const auto index = launch_queue_[chosen];
+        launch_queue_.erase(chosen);
+        if (rate > 0) buckets_[processes_[index].bucket].tokens -= 1;
+        wake = EventLoop::Clock::time_point::max();
+        if (launch_.stagger_ms > 0) {
+            std::uniform_int_distribution<int> gap(0, launch_.stagger_ms);
+            next_launch_ = now + milliseconds(gap(rng_));
+        }
+        respawn(index, processes_[index].launch_restart);
+    }
+
+    if (launch_queue_.empty() && batch_started_ != EventLoop::Clock::time_point{}) {
+        const auto elapsed = duration_cast<milliseconds>(now - batch_started_);
+        print("All queued frpc instance(s) launched in ", NumStr(elapsed.count()), " ms\n");
+        batch_started_ = {};
+    }
+    if (wake == EventLoop::Clock::time_point::max()) return;
+    // one deadline is enough, an earlier pending one re-runs this anyway
+    if (launch_due_ != EventLoop::Clock::time_point{} && launch_due_ <= wake) return;
+    launch_due_ = wake;
+    loop_->schedule(wake, make_token(Source::LAUNCH));
+}
+
+void ProcessManager::respawn(uint32_t index, bool restart) {
+    auto &entry = processes_[index];
+    const auto now = EventLoop::Clock::now();
+
+    if (!entry.process.start(entry.args, spawn_options(entry))) {
+        print("Failed to ", restart ? "restart" : "start", " frpc with config: ", entry.name, "\n");
+        // a failed spawn is a failed run, retried only when on_exit() would
+        if (wants_restart(entry.policy.mode, true)) {
+            schedule_restart(index, now);
         } else {
-            std::strcpy(buffer, "unknown");
+            set_state(index, InstanceState::STOPPED);
+            active_ -= 1;
+        }
+        return;
+    }
+
+    // CLONE_VFORK: the child has exec'd by the time start() returns
+    tracer().record_span(TraceKind::SPAWN, entry.name, now, EventLoop::Clock::now(), entry.process.pid());
+    set_state(index, InstanceState::RUNNING);
+    entry.started_at = now;
+    set_starting(index, now);
+    if (const int fd = entry.process.pidfd(); fd >= 0) {
+        loop_->add(fd, make_token(Source::CHILD, index));
+    }
+    if (entry.ready_from == ReadySource::SPAWN) mark_ready(index);
+    if (!restart) {
+        print("Started frpc with config: ", entry.name, "\n");
+        return;
+    }
+    entry.restarts += 1;
+    print("Restarted frpc with config: ", entry.name, " (restart #", NumStr(entry.restarts), ")\n");
+}
+
+void ProcessManager::retire(uint32_t index) {
+    auto &entry = processes_[index];
+    set_state(index, InstanceState::REMOVED);
+    // closing the read end also drops it from the epoll set
+    entry.output_read.reset();
+    entry.output_write.reset();
+    entry.log = LogSink{};
+    entry.recent_output = OutputRing{};
+    entry.cgroup.destroy();
+    free_slots_.push_back(index);
+    print("Removed instance: ", entry.name, "\n");
+}
+
+InstanceStatus ProcessManager::status(uint32_t index) const {
+    using namespace std::chrono;
+    const auto &entry = processes_[index];
+    const auto state = states_[index];
+    const bool running = state == InstanceState::RUNNING;
+    return {
+        .name = entry.name,
+        // an instance a reload dropped is gone as far as callers are
+        // concerned, even while it is still shutting down
+        .state = entry.pending == PendingAction::REMOVE ? InstanceState::REMOVED : state,
+        .stopping = running && entry.pending != PendingAction::NONE && entry.pending != PendingAction::HANDOVER,
+        .pid = running ? entry.process.pid() : -1,
+        .restarts = entry.restarts,
+        .uptime_ms = running ? duration_cast<milliseconds>(EventLoop::Clock::now() - entry.started_at).count() : 0,
+        .last_exit_code = entry.last_exit_code,
+        .last_signal = entry.last_signal,
+        .usage = running ? entry.usage : ProcStats{},
+        .ready = entry.ready,
+        .ready_ms = entry.ready ? entry.ready_ms : -1,
+    };
+}
+
+int ProcessManager::find(std::string_view name) const {
+    const auto hash = hash_name(name);
+    for (size_t i = 0; i < name_hashes_.size(); ++i) {
+        if (name_hashes_[i] != hash || states_[i] == InstanceState::REMOVED) continue;
+        const auto &entry = processes_[i];
+        if (entry.pending != PendingAction::REMOVE && entry.name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+std::pair<std::string_view, std::string_view> ProcessManager::recent_output(uint32_t index) const {
+    const auto &ring = processes_[index].recent_output;
+    if (ring.empty()) return {};
+    return ring.contents();
+}
+
+bool ProcessManager::start_instance(uint32_t index) {
+    auto &entry = processes_[index];
+    const auto state = states_[index];
+    if (shutting_down() || state == InstanceState::RUNNING || state == InstanceState::QUEUED ||
+        state == InstanceState::REMOVED) {
+        return false;
+    }
+
+    // a manual start gives a parked instance a fresh crash budget
+    entry.window_restarts = 0;
+    entry.consecutive_failures = 0;
+    if (state != InstanceState::BACKOFF) active_ += 1;
+    // an instance that never ran (added by a reload) is started, not restarted
+    launch(index, entry.process.is_valid());
+    return true;
+}
+
+bool ProcessManager::stop_instance(uint32_t index, int timeout_ms) {
+    const auto state = states_[index];
+    if (shutting_down()) return false;
+    if (state == InstanceState::BACKOFF || state == InstanceState::QUEUED) {
+        if (state == InstanceState::QUEUED) dequeue(index);
+        set_state(index, InstanceState::STOPPED);
+        active_ -= 1;
+        return true;
+    }
+    if (state != InstanceState::RUNNING) return false;
+    request_stop(index, PendingAction::STOP, timeout_ms);
+    return true;
+}
+
+bool ProcessManager::restart_instance(uint32_t index, int timeout_ms) {
+    if (shutting_down()) return false;
+    if (states_[index] != InstanceState::RUNNING) return start_instance(index);
+    request_stop(index, PendingAction::RESTART, timeout_ms);
+    return true;
+}
+
+bool ProcessManager::signal_instance(uint32_t index, int sig) {
+    auto &entry = processes_[index];
+    if (states_[index] != InstanceState::RUNNING || entry.pending != PendingAction::NONE) return false;
+    tracer().record(TraceKind::SIGNAL, entry.name, sig);
+    return entry.process.signal(sig);
+}
+
+void ProcessManager::remove_instance(uint32_t index, int timeout_ms) {
+    const auto state = states_[index];
+    if (state == InstanceState::RUNNING) {
+        // the slot is freed by on_exit() once the child is gone
+        request_stop(index, PendingAction::REMOVE, timeout_ms);
+        return;
+    }
+    if (state == InstanceState::QUEUED) dequeue(index);
+    if (state == InstanceState::BACKOFF || state == InstanceState::QUEUED) active_ -= 1;
+    if (state != InstanceState::REMOVED) retire(index);
+}
+
+bool ProcessManager::reconfigure(uint32_t index, std::span<const std::string> args, const InstanceOptions &options,
+                                 int timeout_ms) {
+    auto &entry = processes_[index];
+    entry.policy = options.restart;
+    // new limits apply right away, joining or leaving a cgroup on the next spawn
+    place_in_cgroup(index, options.cgroup);
+    entry.sched = options.sched;
+    entry.bucket = bucket_of(options.server);
+    // takes effect with the next spawn
+    entry.ready_from = options.log.path.empty() && options.ready_from == ReadySource::OUTPUT ? ReadySource::SPAWN
+                                                                                              : options.ready_from;
+
+    // Only the destination of the output can be changed without a respawn:
+    // the child keeps writing into the same pipe, the sink just moves.
+    const bool had_log = static_cast<bool>(entry.output_read);
+    const bool wants_log = !options.log.path.empty();
+    // an unchanged policy keeps its open file, a reload costs nothing here
+    if (had_log && wants_log && (!entry.log.is_open() || entry.log.policy() != options.log)) {
+        if (options.log.ring_size != entry.recent_output.capacity()) {
+            if (options.log.ring_size > 0) {
+                entry.recent_output.allocate(options.log.ring_size);
+            } else {
+                entry.recent_output = OutputRing{};
+            }
+        }
+        if (!entry.log.open(options.log)) {
+            print("Failed to open log file: ", options.log.path, "\n");
+        }
+    }
+
+    // a rendered config that came out the same needs no restart either
+    const bool same_config = entry.rendered == options.rendered ||
+                             (entry.rendered && options.rendered && entry.rendered->hash == options.rendered->hash);
+    entry.rendered = options.rendered;
+    const bool same_args = same_config && std::ranges::equal(entry.arg_storage, args);
+    if (same_args && had_log == wants_log) return false;
+
+    set_args(entry, args);
+    if (had_log != wants_log) {
+        if (entry.output_read && loop_) loop_->remove(entry.output_read.get());
+        entry.output_read.reset();
+        entry.output_write.reset();
+        entry.log = LogSink{};
+        entry.recent_output = OutputRing{};
+        open_output(entry, options.log);
+        if (loop_ && entry.output_read) {
+            loop_->add(entry.output_read.get(), make_token(Source::LOG, index));
+        }
+    }
+
+    // stopped and parked instances pick the new command line up on their
+    // next start, one waiting out a backoff on its restart timer
+    if (states_[index] == InstanceState::RUNNING) {
+        request_stop(index, PendingAction::RESTART, timeout_ms);
+    }
+    return true;
+}
+
+void ProcessManager::request_stop(uint32_t index, PendingAction action, int timeout_ms) {
+    auto &entry = processes_[index];
+    const bool handing_over = entry.handover == Handover::STARTING || entry.handover == Handover::SWITCHING;
+    if (action != PendingAction::HANDOVER && handing_over) fail_handover(index, "the instance is being stopped");
+    const bool already_pending = entry.pending != PendingAction::NONE;
+    entry.pending = action;
+    changes_ += 1;
+    if (already_pending) return;
+
+    entry.process.signal(SIGTERM);
+    tracer().record(TraceKind::SIGNAL, entry.name, SIGTERM);
+    entry.stop_deadline = EventLoop::Clock::now() + std::chrono::milliseconds(timeout_ms);
+    loop_->schedule(entry.stop_deadline, make_token(Source::STOP_DEADLINE, index));
+}
+
+void ProcessManager::on_stop_deadline(uint32_t index) {
+    if (index >= processes_.size()) return;
+    const auto &entry = processes_[index];
+    if (states_[index] != InstanceState::RUNNING || entry.pending == PendingAction::NONE) return;
+    if (EventLoop::Clock::now() < entry.stop_deadline) return;
+    if (force_kill(index)) {
+        print("Process ", entry.name, " did not exit in time, sent SIGKILL\n");
+    }
+}
+
+void ProcessManager::set_binary(Entry &entry, std::string_view binary) {
+    entry.arg_storage.front() = binary;
+    entry.args.front() = entry.arg_storage.front().c_str();
+}
+
+bool ProcessManager::begin_handover(uint32_t index, std::string_view binary, const HandoverPolicy &policy) {
+    using namespace std::chrono;
+    auto &entry = processes_[index];
+    const auto state = states_[index];
+    if (shutting_down() || state == InstanceState::REMOVED || entry.handover == Handover::STARTING ||
+        entry.handover == Handover::SWITCHING) {
+        return false;
+    }
+    // the previous successor has to be reaped before the next one
+    if (entry.successor.is_valid() && !entry.successor.try_wait()) return false;
+    entry.successor_binary = binary;
+    if (state != InstanceState::RUNNING || entry.pending != PendingAction::NONE) {
+        set_binary(entry, binary);
+        entry.handover = Handover::DONE;
+        changes_ += 1;
+        return true;
+    }
+
+    // rare enough that copying argv does not matter
+    std::vector<const char *> args(entry.args);
+    args.front() = entry.successor_binary.c_str();
+    auto options = spawn_options(entry);
+    if (entry.output_read) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            entry.handover = Handover::FAILED;
+            changes_ += 1;
+            print("Upgrade of ", entry.name, " to ", entry.successor_binary, " failed (no output pipe)\n");
+            return true;
+        }
+        entry.successor_read.reset(fds[0]);
+        entry.successor_write.reset(fds[1]);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        options.stdout_fd = fds[1];
+        options.stderr_fd = fds[1];
+    }
+    const auto now = EventLoop::Clock::now();
+    changes_ += 1;
+    if (!entry.successor.start(args, options)) {
+        close_successor_output(entry);
+        entry.handover = Handover::FAILED;
+        print("Upgrade of ", entry.name, " to ", entry.successor_binary, " failed (could not start it)\n");
+        return true;
+    }
+    tracer().record_span(TraceKind::SPAWN, entry.name, now, EventLoop::Clock::now(), entry.successor.pid());
+    if (const int fd = entry.successor.pidfd(); fd >= 0) {
+        loop_->add(fd, make_token(Source::HANDOVER, index));
+    }
+    if (entry.successor_read) loop_->add(entry.successor_read.get(), make_token(Source::HANDOVER_LOG, index));
+    entry.handover = Handover::STARTING;
+    entry.successor_scanner.reset();
+    entry.successor_started = now;
+    entry.successor_ready_ms = -1;
+    entry.handover_stop_ms = policy.stop_timeout_ms;
+    const bool from_output = entry.ready_from == ReadySource::OUTPUT;
+    entry.handover_due = now + milliseconds(from_output ? policy.ready_timeout_ms
+                                                        : std::min(policy.settle_ms, policy.ready_timeout_ms));
+    loop_->schedule(entry.handover_due, make_token(Source::HANDOVER_DUE, index));
+    print("Started ", entry.successor_binary, " next to ", entry.name, " (pid ", NumStr(entry.successor.pid()), ")\n");
+    return true;
+}
+
+void ProcessManager::switch_over(uint32_t index) {
+    using namespace std::chrono;
+    auto &entry = processes_[index];
+    entry.successor_ready_ms = duration_cast<milliseconds>(EventLoop::Clock::now() - entry.successor_started).count();
+    entry.previous_binary = binary(index);
+    set_binary(entry, entry.successor_binary);
+    entry.handover = Handover::SWITCHING;
+    print("Successor of ", entry.name, " ready in ", NumStr(entry.successor_ready_ms), " ms, stopping the old one\n");
+    request_stop(index, PendingAction::HANDOVER, entry.handover_stop_ms);
+}
+
+void ProcessManager::fail_handover(uint32_t index, std::string_view reason, std::string_view detail) {
+    auto &entry = processes_[index];
+    if (entry.handover == Handover::SWITCHING) set_binary(entry, entry.previous_binary);
+    entry.handover = Handover::FAILED;
+    changes_ += 1;
+    // reaped through its Source::HANDOVER token
+    if (entry.successor.signal(SIGKILL)) tracer().record(TraceKind::SIGNAL, entry.name, SIGKILL);
+    print("Upgrade of ", entry.name, " to ", entry.successor_binary, " failed (", reason, detail, "), it stays on ",
+          binary(index), "\n");
+}
+
+void ProcessManager::complete_handover(uint32_t index) {
+    auto &entry = processes_[index];
+    report(entry);
+    entry.sampler.close();
+    entry.usage = {};
+    std::swap(entry.process, entry.successor);
+    entry.pending = PendingAction::NONE;
+    if (const int fd = entry.process.pidfd(); fd >= 0) {
+        loop_->modify(fd, make_token(Source::CHILD, index), EPOLLIN);
+    }
+    // on_exit() drained the old pipe, nothing writes into it any more
+    if (entry.successor_read) {
+        if (entry.output_read) loop_->remove(entry.output_read.get());
+        entry.output_read = std::move(entry.successor_read);
+        entry.output_write = std::move(entry.successor_write);
+        loop_->modify(entry.output_read.get(), make_token(Source::LOG, index), EPOLLIN);
+    }
+    entry.started_at = entry.successor_started;
+    set_starting(index, {});
+    entry.handover = Handover::DONE;
+    changes_ += 1;
+    // the successor proved itself, a probe still has the final say
+    if (!entry.ready && entry.ready_from != ReadySource::PROBE) mark_ready(index);
+    if (entry.ready) entry.ready_ms = entry.successor_ready_ms;
+    print("Process ", entry.name, " handed over to ", binary(index), " (pid ", NumStr(entry.process.pid()), ")\n");
+}
+
+void ProcessManager::on_handover_event(uint32_t index) {
+    if (index >= processes_.size()) return;
+    auto &entry = processes_[index];
+    // reaps a successor that was killed after a failed handover as well
+    if (!entry.successor.try_wait()) return;
+    close_successor_output(entry);
+    const auto handover = entry.handover;
+    if (handover != Handover::STARTING && handover != Handover::SWITCHING) return;
+
+    const int sig = entry.successor.term_signal();
+    fail_handover(index, sig != 0 ? "killed by signal " : "exited with code ",
+                  NumStr(sig != 0 ? sig : entry.successor.exit_code()));
+    // the old child is already stopping, bring the previous binary back
+    if (handover == Handover::SWITCHING) entry.pending = PendingAction::RESTART;
+}
+
+void ProcessManager::on_handover_log(uint32_t index) {
+    if (index >= processes_.size()) return;
+    auto &entry = processes_[index];
+    // only the successor writes here, a login line is its own
+    const bool scan = entry.handover == Handover::STARTING && entry.ready_from == ReadySource::OUTPUT;
+    entry.log.drain(entry.successor_read.get(), &entry.recent_output, scan ? &entry.successor_scanner : nullptr);
+    if (scan && entry.successor_scanner.matched()) switch_over(index);
+}
+
+void ProcessManager::close_successor_output(Entry &entry) {
+    if (!entry.successor_read) return;
+    // the last words of a successor that did not make it
+    entry.log.drain(entry.successor_read.get(), &entry.recent_output);
+    if (loop_) loop_->remove(entry.successor_read.get());
+    entry.successor_read.reset();
+    entry.successor_write.reset();
+}
+
+void ProcessManager::on_handover_due(uint32_t index) {
+    if (index >= processes_.size()) return;
+    const auto &entry = processes_[index];
+    if (entry.handover != Handover::STARTING || EventLoop::Clock::now() < entry.handover_due) return;
+    if (entry.ready_from == ReadySource::OUTPUT) {
+        fail_handover(index, "not ready in time");
+    } else {
+        switch_over(index);
+    }
+}
+
+namespace {
+
+// Handoff state of a re-exec: a header, then one record per instance of
+// 64-bit integers and length-prefixed strings. Native byte order and
+// CLOCK_MONOTONIC time points, it only ever goes from one multi-frp to the
+// next in the same process.
+constexpr std::string_view k_state_magic = "multi-frp-state-1";
+
+struct StateWriter {
+    std::string out;
+
+    void put(int64_t value) { out.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+    void put(std::string_view text) {
+        put(static_cast<int64_t>(text.size()));
+        out += text;
+    }
+    void put(EventLoop::Clock::time_point when) {
+        put(static_cast<int64_t>(std::chrono::nanoseconds(when.time_since_epoch()).count()));
+    }
+};
+
+struct StateReader {
+    std::string_view in;
+    bool ok = true;
+
+    int64_t number() {
+        int64_t value = 0;
+        if (in.size() < sizeof(value)) {
+            ok = false;
+            return 0;
         }
+        std::memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return value;
+    }
+    std::string_view text() {
+        const auto size = number();
+        if (size < 0 || static_cast<uint64_t>(size) > in.size()) {
+            ok = false;
+            return {};
+        }
+        const auto value = in.substr(0, static_cast<size_t>(size));
+        in.remove_prefix(static_cast<size_t>(size));
+        return value;
+    }
+    EventLoop::Clock::time_point when() {
+        return EventLoop::Clock::time_point(
+            std::chrono::duration_cast<EventLoop::Clock::duration>(std::chrono::nanoseconds(number())));
+    }
+};
+
+void set_cloexec(int fd, bool on) {
+    if (fd < 0) return;
+    const int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0) fcntl(fd, F_SETFD, on ? flags | FD_CLOEXEC : flags & ~FD_CLOEXEC);
+}
 
-        print("Process exited with code: ", buffer, "\n");
+} // namespace
+
+bool ProcessManager::can_hand_off(std::string &error) {
+    if (shutting_down()) {
+        error = "shutting down";
+        return false;
     }
-}
\ No newline at end of file
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        auto &entry = processes_[i];
+        if (states_[i] == InstanceState::REMOVED) continue;
+        if (states_[i] == InstanceState::RUNNING && entry.pending != PendingAction::NONE) {
+            error = entry.name + " is being stopped";
+            return false;
+        }
+        // a successor killed after a failed handover has to be reaped here
+        if (entry.successor.is_valid() && !entry.successor.try_wait()) {
+            error = entry.name + " is in the middle of an upgrade";
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProcessManager::set_handoff_cloexec(bool on) {
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (states_[i] != InstanceState::RUNNING) continue;
+        auto &entry = processes_[i];
+        set_cloexec(entry.process.pidfd(), on);
+        set_cloexec(entry.output_read.get(), on);
+        set_cloexec(entry.output_write.get(), on);
+    }
+}
+
+bool ProcessManager::save_state(int fd, std::string &error) {
+    if (!can_hand_off(error)) return false;
+
+    StateWriter state;
+    state.out.reserve(4096 + processes_.size() * 512);
+    state.put(k_state_magic);
+    int64_t count = 0;
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (states_[i] != InstanceState::REMOVED) count += 1;
+    }
+    state.put(count);
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        const auto current = states_[i];
+        if (current == InstanceState::REMOVED) continue;
+        const auto &entry = processes_[i];
+        const bool running = current == InstanceState::RUNNING;
+        state.put(entry.name);
+        state.put(static_cast<int64_t>(entry.arg_storage.size()));
+        for (const auto &arg : entry.arg_storage) {
+            state.put(arg);
+        }
+        state.put(static_cast<int64_t>(current));
+        state.put(running ? entry.process.pid() : -1);
+        state.put(running ? entry.process.pidfd() : -1);
+        state.put(running ? entry.output_read.get() : -1);
+        state.put(running ? entry.output_write.get() : -1);
+        state.put(entry.ready ? entry.ready_ms : -1);
+        state.put(entry.restarts);
+        state.put(entry.last_exit_code);
+        state.put(entry.last_signal);
+        state.put(entry.window_restarts);
+        state.put(entry.consecutive_failures);
+        state.put(entry.started_at);
+        state.put(entry.window_start);
+        state.put(entry.restart_at);
+    }
+
+    for (size_t written = 0; written < state.out.size();) {
+        const auto got = write(fd, state.out.data() + written, state.out.size() - written);
+        if (got <= 0) {
+            error = "could not write the handoff state";
+            return false;
+        }
+        written += static_cast<size_t>(got);
+    }
+    set_handoff_cloexec(false);
+    return true;
+}
+
+void ProcessManager::cancel_handoff() {
+    set_handoff_cloexec(true);
+}
+
+size_t ProcessManager::restore_state(int fd, std::vector<std::string> &dropped) {
+    struct stat st;
+    std::string buffer;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        buffer.resize(static_cast<size_t>(st.st_size));
+        if (pread(fd, buffer.data(), buffer.size(), 0) != st.st_size) buffer.clear();
+    }
+    StateReader state{buffer};
+    if (state.text() != k_state_magic || !state.ok) {
+        print("Error: the state handed over by the previous multi-frp is unreadable, "
+              "its frpc instances are no longer supervised\n");
+        return 0;
+    }
+    resumed_ = true;
+
+    size_t adopted = 0;
+    std::vector<std::string> args;
+    const auto count = state.number();
+    for (int64_t n = 0; n < count && state.ok; ++n) {
+        const auto name = state.text();
+        args.resize(static_cast<size_t>(std::clamp<int64_t>(state.number(), 0, 4096)));
+        for (auto &arg : args) {
+            arg = state.text();
+        }
+        const auto recorded = static_cast<InstanceState>(state.number());
+        const auto pid = static_cast<int>(state.number());
+        const auto pidfd = static_cast<int>(state.number());
+        const auto output_read = static_cast<int>(state.number());
+        const auto output_write = static_cast<int>(state.number());
+        const auto ready_ms = state.number();
+        if (!state.ok) break;
+
+        int found = find(name);
+        if (found < 0) {
+            found = static_cast<int>(add_process(name, args, {}));
+            dropped.emplace_back(name);
+        }
+        const auto index = static_cast<uint32_t>(found);
+        auto &entry = processes_[index];
+        entry.restarts = static_cast<int>(state.number());
+        entry.last_exit_code = static_cast<int>(state.number());
+        entry.last_signal = static_cast<int>(state.number());
+        entry.window_restarts = static_cast<int>(state.number());
+        entry.consecutive_failures = static_cast<int>(state.number());
+        entry.started_at = state.when();
+        entry.window_start = state.when();
+        entry.restart_at = state.when();
+
+        // a queued launch simply starts over with start_all()
+        if (recorded == InstanceState::QUEUED) continue;
+        entry.resumed = true;
+        if (recorded == InstanceState::BACKOFF) active_ += 1;
+        if (recorded != InstanceState::RUNNING) {
+            set_state(index, recorded);
+            continue;
+        }
+
+        // the child keeps writing into the pipe it was spawned with
+        if (output_read >= 0 && output_write >= 0) {
+            if (loop_ && entry.output_read) loop_->remove(entry.output_read.get());
+            entry.output_read.reset(output_read);
+            entry.output_write.reset(output_write);
+            set_cloexec(output_read, true);
+            set_cloexec(output_write, true);
+        }
+        set_cloexec(pidfd, true);
+        entry.process.adopt(pid, pidfd);
+        if (!std::ranges::equal(entry.arg_storage, args)) {
+            print("Process ", entry.name, " runs an older command line than the config, a reload applies it\n");
+            set_args(entry, args);
+        }
+        set_state(index, InstanceState::RUNNING);
+        active_ += 1;
+        if (ready_ms >= 0) {
+            entry.ready = true;
+            entry.ready_ms = ready_ms;
+            ready_ += 1;
+        } else if (entry.ready_from != ReadySource::SPAWN) {
+            set_starting(index, entry.started_at);
+        }
+        adopted += 1;
+    }
+    if (!state.ok) print("Error: the state handed over by the previous multi-frp is truncated\n");
+    print("Took over ", NumStr(static_cast<long long>(adopted)), " running frpc instance(s) from the previous multi-frp\n");
+    return adopted;
+}
+
+size_t ProcessManager::parked_count() const {
+    return std::ranges::count(states_, InstanceState::PARKED);
+}
+
+void ProcessManager::shutdown(EventLoop &loop, int timeout_ms) {
+    shutdown_started_ = EventLoop::Clock::now();
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        const auto handover = processes_[i].handover;
+        if (handover == Handover::STARTING || handover == Handover::SWITCHING) fail_handover(i, "shutting down");
+        const auto state = states_[i];
+        if (state == InstanceState::RUNNING) {
+            processes_[i].process.signal(SIGTERM);
+            tracer().record(TraceKind::SIGNAL, processes_[i].name, SIGTERM);
+        } else if (state == InstanceState::BACKOFF || state == InstanceState::QUEUED) {
+            set_state(i, InstanceState::STOPPED);
+            active_ -= 1;
+        }
+    }
+    launch_queue_.clear();
+    loop.schedule(shutdown_started_ + std::chrono::milliseconds(timeout_ms), make_token(Source::SHUTDOWN));
+}
+
+void ProcessManager::kill_remaining() {
+    for (uint32_t i = 0; i < processes_.size(); ++i) {
+        if (force_kill(i)) {
+            print("Process ", processes_[i].name, " did not exit in time, sent SIGKILL\n");
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -2,14 +2,412 @@
 
 #include "util/trait.hpp"
 #include "process/process.h"
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <span>
 
+#ifndef _WIN32
+#include "process/cgroup.h"
+#include "process/event_loop.h"
+#include "process/log_sink.h"
+#include "process/proc_stats.h"
+#include "process/ready_scanner.h"
+#include "util/unique_fd.hpp"
+#endif
+
+enum class RestartMode : unsigned char {
+    ALWAYS,
+    ON_FAILURE,
+    NEVER,
+};
+
+struct RestartPolicy {
+    RestartMode mode = RestartMode::ON_FAILURE;
+    int initial_backoff_ms = 1000;
+    int max_backoff_ms = 60000;
+    double jitter = 0.2; // each delay is scaled by a random factor in [1 - jitter, 1 + jitter]
+    int max_restarts = 5; // restarts allowed within window_ms before the instance is parked
+    int window_ms = 60000;
+};
+
+#ifndef _WIN32
+// Pacing of spawns, so a reboot or a mass failure does not send every frpc
+// at the frps servers in the same instant. Instances waiting for their turn
+// are QUEUED; initial starts, restarts and respawns all go through it.
+struct LaunchPolicy {
+    int max_starting = 0; // instances starting at once, 0 for no limit
+    int settle_ms = 3000; // a spawned instance counts as starting for this long
+    int stagger_ms = 0;   // random gap of up to this between two launches
+    double server_rate = 0; // launches per second against one frps, 0 for no limit
+    int server_burst = 1;
+
+    bool limited() const { return max_starting > 0 || stagger_ms > 0 || server_rate > 0; }
+};
+
+// Timing of one handover of a rolling upgrade, see begin_handover().
+struct HandoverPolicy {
+    int ready_timeout_ms = 60000; // the successor has to be ready by then
+    int settle_ms = 5000; // without ReadySource::OUTPUT, alive this long counts as ready
+    int stop_timeout_ms = 5000; // the old child's grace after SIGTERM
+};
+
+// What makes a spawned instance count as ready, i.e. logged in to its frps.
+enum class ReadySource : unsigned char {
+    SPAWN,  // running is all there is to go on
+    OUTPUT, // "login to server success" or "start proxy success" in its output
+    PROBE,  // its first passing health probe
+};
+#endif
+
+#ifndef _WIN32
+// An frpc config that only exists in a sealed memfd, shared by every spawn of
+// its instance; `hash` of the contents lets a reload tell whether it changed.
+struct RenderedConfig : Unique {
+    UniqueFd fd;
+    uint64_t hash = 0;
+};
+#endif
+
+struct InstanceOptions {
+    RestartPolicy restart;
+#ifndef _WIN32
+    // frps the instance logs in to ("host:port"), launches against the same
+    // server share one token bucket
+    std::string server;
+    ReadySource ready_from = ReadySource::SPAWN; // OUTPUT needs a log path
+    LogPolicy log;
+    // own cgroup with these limits, needs enable_cgroups()
+    std::optional<CgroupLimits> cgroup;
+    // picked up by the next spawn
+    SchedOptions sched;
+    // config rendered in memory, passed to frpc as k_config_fd; `args`
+    // names k_config_fd_path then
+    std::shared_ptr<const RenderedConfig> rendered;
+#endif
+};
+
+enum class InstanceState : unsigned char {
+    RUNNING,
+    BACKOFF, // exited, waiting for its restart timer
+    STOPPED,
+    PARKED, // crash looping, given up until started again by hand
+    REMOVED, // dropped by a config reload, its slot is free for reuse
+    QUEUED, // waiting for the launch scheduler to let it spawn
+};
+
+const char *state_name(InstanceState state);
+
+#ifndef _WIN32
+// point-in-time view of one instance, for status queries
+struct InstanceStatus {
+    std::string_view name;
+    InstanceState state;
+    bool stopping; // SIGTERM sent on request, exit not seen yet
+    int pid;
+    int restarts;
+    int64_t uptime_ms;
+    int last_exit_code; // -1 until the first exit
+    int last_signal;
+    ProcStats usage; // as of the last sample_usage(), zero when not running
+    bool ready;
+    int64_t ready_ms; // from the last spawn until it was ready, -1 before
+};
+
+// Progress of the rolling upgrade of one instance, see begin_handover().
+enum class Handover : unsigned char {
+    NONE,
+    STARTING,  // successor spawned next to the running child, not ready yet
+    SWITCHING, // successor ready, the old child got SIGTERM
+    DONE,
+    FAILED, // the instance stays on (or goes back to) its previous binary
+};
+#endif
+
 struct ProcessManager : Unique {
-    bool add_process(std::span<const char *const> args);
-    void terminate_all();
+    // Size the instance table once from the config. Everything an instance
+    // needs (argv, pipe, ring buffer, Process) is allocated when it is added,
+    // so supervising, restarting and logging never touch the heap; only a
+    // reload adding instances beyond this capacity grows the table.
+    void reserve(size_t count);
+    // Register an instance and return its index, nothing is spawned until
+    // start_all() or start_instance(). `args` starts with the frpc path.
+    uint32_t add_process(std::string_view name, std::span<const std::string> args, const InstanceOptions &options = {});
+    // Launch every registered instance in one batch and report the time it
+    // took until all of them were running.
+    bool start_all();
+    // Stop everything without an event loop (startup failed): SIGTERM all
+    // children at once, SIGKILL whoever outlives the shared deadline.
+    void terminate_all(int timeout_ms);
     void wait_all();
 
+#ifndef _WIN32
+    // A running instance became ready (see ReadySource); idempotent. An
+    // instance stops being ready when it exits.
+    void mark_ready(uint32_t index);
+    size_t ready_count() const { return ready_; }
+
+    // Takes effect for the next launch; the queue is kept.
+    void set_launch_policy(const LaunchPolicy &policy);
+    void on_launch_due();
+
+    // Set up the delegated cgroup tree, once. Instances registered with
+    // cgroup limits afterwards each get their own cgroup.
+    bool enable_cgroups();
+
+    // Register every child's pidfd with `loop` under Source::CHILD tokens,
+    // so an exit is reaped the moment it happens. Restarts are scheduled on
+    // the same loop as Source::RESTART deadlines.
+    void watch(EventLoop &loop);
+    void on_child_event(uint32_t index);
+    void on_restart_due(uint32_t index);
+    void on_log_event(uint32_t index);
+    // Refresh the resource usage of every running child from /proc.
+    void sample_usage();
+    // Print the recent output kept for every instance (SIGUSR1).
+    void dump_output();
+    // Fallback for children without a pidfd, driven by SIGCHLD.
+    void on_sigchld();
+
+    // children that are running, queued or waiting out a restart backoff
+    size_t active_count() const { return active_; }
+    size_t parked_count() const;
+
+    size_t size() const { return processes_.size(); }
+    // bumped by every change status() would show apart from uptime and
+    // usage, so a consumer can skip its pass while nothing happened
+    uint64_t changes() const { return changes_; }
+    InstanceStatus status(uint32_t index) const;
+    // index of the instance called `name`, -1 if there is none
+    int find(std::string_view name) const;
+    // contents of the instance's recent output ring, oldest first
+    std::pair<std::string_view, std::string_view> recent_output(uint32_t index) const;
+
+    // On-demand control of a single instance. None of them block: a stop
+    // sends SIGTERM and the exit is picked up by the loop like any other,
+    // SIGKILL follows after `timeout_ms` (a Source::STOP_DEADLINE token).
+    // A restart respawns as soon as the exit is seen, without backoff.
+    // Each returns false when the instance is not in a state it applies to.
+    bool start_instance(uint32_t index);
+    bool stop_instance(uint32_t index, int timeout_ms);
+    bool restart_instance(uint32_t index, int timeout_ms);
+    // Pass `sig` on to a running instance that is not being stopped.
+    bool signal_instance(uint32_t index, int sig);
+    void on_stop_deadline(uint32_t index);
+
+    // Rolling upgrade of one instance to `binary`. The successor is spawned
+    // with the same arguments, output pipe and cgroup next to the running
+    // child. Once it is ready (its login line with ReadySource::OUTPUT,
+    // otherwise still running after `settle_ms`) the old child gets SIGTERM
+    // and the successor carries on in the slot, without a restart. A
+    // successor that exits first or is not ready in time is killed and the
+    // old child is left alone. An instance that is not running just starts
+    // `binary` the next time.
+    bool begin_handover(uint32_t index, std::string_view binary, const HandoverPolicy &policy);
+    Handover handover(uint32_t index) const { return processes_[index].handover; }
+    std::string_view binary(uint32_t index) const { return processes_[index].arg_storage.front(); }
+    // Source::HANDOVER (the successor's pidfd), Source::HANDOVER_LOG (its
+    // output pipe) and Source::HANDOVER_DUE
+    void on_handover_event(uint32_t index);
+    void on_handover_log(uint32_t index);
+    void on_handover_due(uint32_t index);
+
+    // Config reload support. remove_instance() stops the instance like
+    // stop_instance() and frees its slot once the exit is seen.
+    // reconfigure() applies new restart and log settings in place and only
+    // restarts the instance when its command line changed; it returns
+    // whether a restart was needed.
+    void remove_instance(uint32_t index, int timeout_ms);
+    bool reconfigure(uint32_t index, std::span<const std::string> args, const InstanceOptions &options,
+                     int timeout_ms);
+    // the in-memory config an instance runs with, null for a file on disk
+    const std::shared_ptr<const RenderedConfig> &rendered(uint32_t index) const { return processes_[index].rendered; }
+
+    // Parallel shutdown: SIGTERM every child at once and SIGKILL whoever is
+    // still alive once the shared deadline (a Source::SHUTDOWN token) fires.
+    // Total stop time is bounded by the slowest child, not the sum.
+    void shutdown(EventLoop &loop, int timeout_ms);
+    void kill_remaining();
+    bool shutting_down() const { return shutdown_started_ != EventLoop::Clock::time_point{}; }
+
+    // Supervisor re-exec. save_state() writes every instance's child, output
+    // pipe and restart bookkeeping to `fd` and lets those descriptors survive
+    // exec; cancel_handoff() puts close-on-exec back when the exec failed.
+    // Refused (with the reason in `error`) while a stop or an upgrade
+    // handover is in flight, whose progress could not be carried over.
+    bool can_hand_off(std::string &error);
+    bool save_state(int fd, std::string &error);
+    void cancel_handoff();
+    // In the new image, after add_process() and before start_all(): take the
+    // recorded children over by name instead of spawning them. Recorded
+    // instances the config no longer has are registered with their old
+    // command line and their names go to `dropped`, to be removed once
+    // watch() has run. Returns the number of running children taken over.
+    // From then on start_all() leaves an instance it cannot spawn stopped
+    // rather than failing, so the taken over children are not torn down.
+    size_t restore_state(int fd, std::vector<std::string> &dropped);
+    bool resumed() const { return resumed_; }
+#endif
+
 private:
-    std::vector<Process> processes_;
+    enum class PendingAction : unsigned char {
+        NONE,
+        STOP,
+        RESTART,
+        REMOVE,
+        HANDOVER, // stopped in favour of the successor
+    };
+
+    struct Entry {
+        std::string name;
+        std::vector<std::string> arg_storage;
+        std::vector<const char *> args;
+        RestartPolicy policy;
+        Process process;
+#ifndef _WIN32
+        // Output pipe kept for the instance's whole life: every respawn gets
+        // the same write end, so the read end stays registered in the loop.
+        UniqueFd output_read;
+        UniqueFd output_write;
+        LogSink log;
+        OutputRing recent_output;
+        Cgroup cgroup;
+        SchedOptions sched;
+        std::shared_ptr<const RenderedConfig> rendered;
+        ProcSampler sampler;
+        ProcStats usage;
+        uint32_t bucket = 0;
+        bool launch_restart = false; // what the queued launch reports as
+        ReadySource ready_from = ReadySource::SPAWN;
+        ReadyScanner scanner;
+        bool ready = false;
+        int64_t ready_ms = -1;
+        bool resumed = false; // taken over from before a re-exec, until watch()
+
+        PendingAction pending = PendingAction::NONE;
+        EventLoop::Clock::time_point stop_deadline{};
+        EventLoop::Clock::time_point started_at{};
+        EventLoop::Clock::time_point restart_at{};
+        EventLoop::Clock::time_point window_start{};
+        int window_restarts = 0;
+        int consecutive_failures = 0;
+        int restarts = 0;
+        int last_exit_code = -1;
+        int last_signal = 0;
+
+        // rolling upgrade, the successor runs next to `process` until it
+        // takes over the slot
+        Handover handover = Handover::NONE;
+        Process successor;
+        std::string successor_binary;
+        std::string previous_binary;
+        ReadyScanner successor_scanner;
+        // a pipe of its own, so the old child's reconnect lines cannot pass
+        // for the successor's login; it becomes the slot's pipe on takeover
+        UniqueFd successor_read;
+        UniqueFd successor_write;
+        EventLoop::Clock::time_point successor_started{};
+        EventLoop::Clock::time_point handover_due{};
+        int64_t successor_ready_ms = -1;
+        int handover_stop_ms = 5000;
+#endif
+    };
+
+    void set_state(uint32_t index, InstanceState state);
+    static void set_args(Entry &entry, std::span<const std::string> args);
+    static uint64_t hash_name(std::string_view name);
+    void report(Entry &entry);
+#ifndef _WIN32
+    void dump_output(const Entry &entry);
+#endif
+    SpawnOptions spawn_options(const Entry &entry) const;
+
+#ifndef _WIN32
+    void open_output(Entry &entry, const LogPolicy &policy);
+    void place_in_cgroup(uint32_t index, const std::optional<CgroupLimits> &limits);
+    bool force_kill(uint32_t index);
+    void on_exit(uint32_t index);
+    void schedule_restart(uint32_t index, EventLoop::Clock::time_point now);
+    void respawn(uint32_t index, bool restart = true);
+    void clear_ready(Entry &entry);
+    // still logging in, counted against LaunchPolicy::max_starting
+    bool starting(uint32_t index, EventLoop::Clock::time_point now) const;
+    // the only writer of starting_since_, keeps starting_ in step
+    void set_starting(uint32_t index, EventLoop::Clock::time_point since);
+    // respawn() through the launch scheduler
+    void launch(uint32_t index, bool restart = true);
+    void pump_launches();
+    void dequeue(uint32_t index);
+    uint32_t bucket_of(std::string_view server);
+    void retire(uint32_t index);
+    void request_stop(uint32_t index, PendingAction action, int timeout_ms);
+    static void set_binary(Entry &entry, std::string_view binary);
+    void switch_over(uint32_t index);
+    // `detail` is appended to `reason`, an exit code or signal number
+    void fail_handover(uint32_t index, std::string_view reason, std::string_view detail = {});
+    void close_successor_output(Entry &entry);
+    // the old child is gone, the successor takes its place
+    void complete_handover(uint32_t index);
+    // close-on-exec of the descriptors save_state() hands over
+    void set_handoff_cloexec(bool on);
+#endif
+
+    std::vector<Entry> processes_;
+    // Columns parallel to processes_ with what the passes over the whole
+    // table read (slot reuse, lookups by name, launch slots, reaping and
+    // shutdown), so those stay a few cache lines long with thousands of
+    // instances instead of touching every Entry.
+    std::vector<InstanceState> states_;
+    std::vector<uint64_t> name_hashes_;
+#ifndef _WIN32
+    // spawn time while the instance holds a launch slot, {} otherwise
+    std::vector<EventLoop::Clock::time_point> starting_since_;
+#endif
+    size_t active_ = 0;
+    uint64_t changes_ = 0;
+#ifndef _WIN32
+    EventLoop *loop_ = nullptr;
+    size_t ready_ = 0;
+    // instances with a starting_since_, some may have settled unnoticed
+    size_t starting_ = 0;
+    CgroupTree cgroups_;
+    EventLoop::Clock::time_point shutdown_started_{};
+    bool resumed_ = false;
+    std::vector<uint32_t> free_slots_; // REMOVED entries add_process() reuses
+    std::minstd_rand rng_{std::random_device{}()};
+
+    // token bucket of one frps server
+    struct Bucket {
+        std::string server;
+        double tokens = 0;
+        EventLoop::Clock::time_point refilled{};
+    };
+    // instance indices in launch order, in a ring sized once: launching
+    // from the front is O(1), and no push or pop touches the heap
+    struct LaunchQueue {
+        void reserve(size_t capacity);
+        bool empty() const { return size_ == 0; }
+        size_t size() const { return size_; }
+        uint32_t operator[](size_t position) const { return ring_[(head_ + position) % ring_.size()]; }
+        void push_back(uint32_t index);
+        // the front is O(1), others shift the ones queued behind them
+        void erase(size_t position);
+        void clear() { head_ = size_ = 0; }
+
+    private:
+        std::vector<uint32_t> ring_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+
+    LaunchPolicy launch_;
+    std::vector<Bucket> buckets_;
+    LaunchQueue launch_queue_;
+    EventLoop::Clock::time_point next_launch_{}; // end of the current stagger gap
+    EventLoop::Clock::time_point launch_due_{}; // pending Source::LAUNCH deadline, if any
+    EventLoop::Clock::time_point batch_started_{}; // start_all() queued everything at this time
+#endif
 };
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+// Streaming search of a child's output for the lines frpc prints once it is
+// logged in. Output arrives in arbitrary chunks, so the last few bytes of each
+// chunk are carried over to catch a marker split across two of them.
+struct ReadyScanner {
+    static constexpr std::string_view k_markers[] = {
+        "login to server success",
+        "start proxy success",
+    };
+    static constexpr size_t k_carry = std::max(k_markers[0].size(), k_markers[1].size()) - 1;
+
+    bool matched() const { return matched_; }
+    void reset() {
+        matched_ = false;
+        carried_ = 0;
+    }
+
+    // true once a marker has been seen, in this chunk or an earlier one
+    bool feed(std::string_view chunk) {
+        if (matched_ || chunk.empty()) return matched_;
+
+        // the seam between the carried tail and the new chunk
+        char seam[k_carry * 2];
+        const size_t head = std::min(chunk.size(), k_carry);
+        std::memcpy(seam, carry_, carried_);
+        std::memcpy(seam + carried_, chunk.data(), head);
+        matched_ = contains({seam, carried_ + head}) || contains(chunk);
+
+        if (chunk.size() >= k_carry) {
+            std::memcpy(carry_, chunk.data() + chunk.size() - k_carry, k_carry);
+            carried_ = k_carry;
+        } else {
+            // keep the newest k_carry bytes of carry + chunk
+            const size_t total = carried_ + chunk.size();
+            const size_t drop = total > k_carry ? total - k_carry : 0;
+            std::memmove(carry_, carry_ + drop, carried_ - drop);
+            std::memcpy(carry_ + carried_ - drop, chunk.data(), chunk.size());
+            carried_ = total - drop;
+        }
+        return matched_;
+    }
+
+private:
+    static bool contains(std::string_view text) {
+        return std::ranges::any_of(k_markers, [&](std::string_view marker) {
+            return text.find(marker) != std::string_view::npos;
+        });
+    }
+
+    char carry_[k_carry];
+    size_t carried_ = 0;
+    bool matched_ = false;
+};
+
+#endif // !_WIN32
@@ -0,0 +1,144 @@
+#include "process/trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "util/print.hpp"
+
+namespace {
+
+const char *kind_name(TraceKind kind) {
+    switch (kind) {
+        case TraceKind::CONFIG: return "config";
+        case TraceKind::RELOAD: return "reload";
+        case TraceKind::SPAWN: return "spawn";
+        case TraceKind::QUEUED: return "queued";
+        case TraceKind::READY: return "ready";
+        case TraceKind::PROBE: return "probe";
+        case TraceKind::SIGNAL: return "signal";
+        case TraceKind::EXIT: return "exit";
+        case TraceKind::BACKOFF: return "backoff";
+        case TraceKind::PARKED: return "parked";
+        case TraceKind::LIMIT: return "limit";
+    }
+    return "unknown";
+}
+
+const char *value_name(TraceKind kind, int32_t value) {
+    switch (kind) {
+        case TraceKind::SPAWN: return "pid";
+        case TraceKind::PROBE: return "passed";
+        case TraceKind::SIGNAL: return "signal";
+        case TraceKind::EXIT: return value < 0 ? "signal" : "code";
+        case TraceKind::BACKOFF: return "delay_ms";
+        case TraceKind::LIMIT: return "usage";
+        default: return nullptr;
+    }
+}
+
+// microseconds with a fraction, what the format expects
+void append_us(std::string &out, int64_t ns) {
+    out += NumStr(ns / 1000);
+    const auto frac = NumStr(1000 + ns % 1000);
+    out += '.';
+    out += std::string_view(frac).substr(1);
+}
+
+void append_string(std::string &out, std::string_view text) {
+    out += '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    out += '"';
+}
+
+} // namespace
+
+TraceRing &tracer() {
+    static TraceRing ring;
+    return ring;
+}
+
+void TraceRing::allocate(size_t capacity) {
+    events_ = capacity > 0 ? std::make_unique<Event[]>(capacity) : nullptr;
+    capacity_ = capacity;
+    recorded_ = 0;
+    name_ids_.clear();
+    names_.clear();
+    intern("");
+}
+
+uint32_t TraceRing::intern(std::string_view instance) {
+    if (const auto found = name_ids_.find(instance); found != name_ids_.end()) return found->second;
+    const auto id = static_cast<uint32_t>(names_.size());
+    names_.push_back(name_ids_.emplace(instance, id).first->first);
+    return id;
+}
+
+void TraceRing::record_span(TraceKind kind, std::string_view instance, Clock::time_point begin, Clock::time_point end,
+                            int32_t value) {
+    if (capacity_ == 0) return;
+    auto &event = events_[recorded_ % capacity_];
+    recorded_ += 1;
+    event.ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin.time_since_epoch()).count();
+    event.dur_ns = end == Clock::time_point{} ? -1 : std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    event.value = value;
+    event.kind = kind;
+    event.instance = intern(instance);
+}
+
+void TraceRing::write_json(std::string &out) const {
+    const size_t count = std::min<uint64_t>(recorded_, capacity_);
+    const size_t first = recorded_ > capacity_ ? recorded_ % capacity_ : 0;
+
+    // one track (tid) per instance name, the supervisor's own events on
+    // tid 1; a track is named when its first event still in the ring is
+    std::vector<bool> named(names_.size());
+    if (!named.empty()) named[0] = true;
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += R"({"name":"process_name","ph":"M","pid":1,"tid":1,"args":{"name":"multi-frp"}},)";
+    out += R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"supervisor"}})";
+    for (size_t i = 0; i < count; ++i) {
+        const auto &event = events_[(first + i) % capacity_];
+        const auto tid = NumStr(static_cast<long long>(event.instance) + 1);
+        if (!named[event.instance]) {
+            named[event.instance] = true;
+            out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+            out += tid;
+            out += ",\"args\":{\"name\":";
+            append_string(out, names_[event.instance]);
+            out += "}}";
+        }
+
+        out += ",\n{\"name\":\"";
+        out += kind_name(event.kind);
+        out += event.dur_ns >= 0 ? "\",\"ph\":\"X\",\"dur\":" : "\",\"ph\":\"i\",\"s\":\"t\"";
+        if (event.dur_ns >= 0) append_us(out, event.dur_ns);
+        out += ",\"pid\":1,\"tid\":";
+        out += tid;
+        out += ",\"ts\":";
+        append_us(out, event.ts_ns);
+        if (const char *label = value_name(event.kind, event.value)) {
+            out += ",\"args\":{\"";
+            out += label;
+            out += "\":";
+            out += NumStr(event.kind == TraceKind::EXIT && event.value < 0 ? -event.value : event.value);
+            out += '}';
+        }
+        out += '}';
+    }
+    out += "\n]}\n";
+}
+
+bool TraceRing::write_file(const std::string &path) const {
+    std::string text;
+    write_json(text);
+    const auto temp = path + ".tmp";
+    FILE *file = std::fopen(temp.c_str(), "wb");
+    if (!file) return false;
+    const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (std::fclose(file) != 0 || !written) return false;
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
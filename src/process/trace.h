@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "util/trait.hpp"
+
+enum class TraceKind : uint8_t {
+    CONFIG,  // config parsed and validated (span)
+    RELOAD,  // config reload applied (span)
+    SPAWN,   // clone until the child has exec'd (span), value is the pid
+    QUEUED,  // waiting for the launch scheduler
+    READY,
+    PROBE,   // value 1 passed, 0 failed
+    SIGNAL,  // value is the signal sent
+    EXIT,    // reaped, value is the exit code or minus the signal
+    BACKOFF, // restart scheduled, value is the delay in ms
+    PARKED,
+    LIMIT,   // resource limit breached, value in MB, % or count
+};
+
+// Flight recorder of lifecycle events in a fixed ring allocated once.
+// Recording is a clock read, a lookup of the instance name and a copy into
+// the next slot: no syscall, no formatting, and no allocation except the
+// one interning a name the first time it is seen. The newest events
+// overwrite the oldest. Only the dump formats them, as Chrome trace JSON
+// (chrome://tracing, Perfetto) with one track per instance.
+struct TraceRing : Unique {
+    using Clock = std::chrono::steady_clock;
+
+    // `capacity` events, 0 turns recording off; drops what was recorded
+    void allocate(size_t capacity);
+    bool enabled() const { return capacity_ > 0; }
+
+    void record(TraceKind kind, std::string_view instance, int32_t value = 0) {
+        record_span(kind, instance, Clock::now(), {}, value);
+    }
+    // `end` left default makes an instant event at `begin`
+    void record_span(TraceKind kind, std::string_view instance, Clock::time_point begin, Clock::time_point end,
+                     int32_t value = 0);
+
+    void write_json(std::string &out) const;
+    // atomically via a temporary file, false if it could not be written
+    bool write_file(const std::string &path) const;
+
+private:
+    struct Event {
+        int64_t ts_ns;
+        int64_t dur_ns;
+        int32_t value;
+        TraceKind kind;
+        uint32_t instance; // into names_, 0 is the supervisor
+    };
+
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+
+    uint32_t intern(std::string_view instance);
+
+    std::unique_ptr<Event[]> events_;
+    // every name ever recorded, in full; names_ views the map's keys
+    std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>> name_ids_;
+    std::vector<std::string_view> names_;
+    size_t capacity_ = 0;
+    uint64_t recorded_ = 0; // total ever, the next slot is recorded_ % capacity_
+};
+
+// the supervisor's recorder, off until allocate()d
+TraceRing &tracer();
@@ -2,12 +2,128 @@
 
 #include "process/process.h"
 
+#include <cerrno>
 #include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// mirrors the kernel's struct clone_args (linux/sched.h), whose CLONE_*
+// macros would clash with the ones glibc's <sched.h> already defines
+struct CloneArgs {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+constexpr uint64_t k_clone_into_cgroup = 0x200000000ULL; // CLONE_INTO_CGROUP, Linux 5.7
+
+void apply_sched(const SchedOptions &sched) {
+    if (sched.pin) sched_setaffinity(0, sizeof(sched.cpus), &sched.cpus);
+    if (sched.numa_node >= 0 && sched.numa_node < 64) {
+        constexpr int k_mpol_preferred = 1;
+        const unsigned long nodes = 1UL << sched.numa_node;
+        syscall(SYS_set_mempolicy, k_mpol_preferred, &nodes, sizeof(nodes) * 8 + 1);
+    }
+    if (sched.renice) setpriority(PRIO_PROCESS, 0, sched.nice);
+    if (sched.io_class > 0) {
+        constexpr int k_ioprio_who_process = 1;
+        syscall(SYS_ioprio_set, k_ioprio_who_process, 0, (sched.io_class << 13) | sched.io_level);
+    }
+    if (sched.policy >= 0) {
+        const sched_param param{};
+        sched_setscheduler(0, sched.policy, &param);
+    }
+}
+
+// Runs in the child between clone and exec. Only raw syscalls on stack data
+// here: the parent may be suspended on us (CLONE_VFORK).
+[[noreturn]] void exec_child(const char *const *argv, const SpawnOptions &options, int error_fd, bool join_cgroup) {
+    // Create new process group
+    setpgid(0, 0);
+
+    // without CLONE_INTO_CGROUP the child moves itself before exec
+    if (join_cgroup) {
+        const int procs = openat(options.cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (procs >= 0) {
+            [[maybe_unused]] auto _ = write(procs, "0", 1);
+            close(procs);
+        }
+    }
+
+    if (options.sched) apply_sched(*options.sched);
+
+    if (options.stdout_fd >= 0) dup2(options.stdout_fd, STDOUT_FILENO);
+    if (options.stderr_fd >= 0) dup2(options.stderr_fd, STDERR_FILENO);
+    if (options.config_fd >= 0) {
+        // keep the error pipe clear of the slot the config goes into
+        if (error_fd == k_config_fd) error_fd = fcntl(error_fd, F_DUPFD_CLOEXEC, k_config_fd + 1);
+        if (options.config_fd == k_config_fd) {
+            fcntl(k_config_fd, F_SETFD, 0);
+        } else {
+            dup2(options.config_fd, k_config_fd);
+        }
+    }
+
+    // The supervisor blocks its termination signals to read them from a
+    // signalfd, and the mask survives exec. Hand frpc a clean one.
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, nullptr);
+
+    execve(argv[0], const_cast<char *const *>(argv), environ);
+
+    // If execve returns, there was an error: report errno to the parent
+    const int error = errno;
+    [[maybe_unused]] auto _ = write(error_fd, &error, sizeof(error));
+    _exit(127);
+}
+
+} // namespace
+
+std::string find_executable(std::string_view name) {
+    if (name.empty() || name.find('/') != std::string_view::npos) {
+        return std::string(name);
+    }
+
+    const char *path = std::getenv("PATH");
+    std::string_view dirs = path ? path : "/usr/local/bin:/usr/bin:/bin";
+    std::string candidate;
+    while (true) {
+        const auto sep = dirs.find(':');
+        const auto dir = dirs.substr(0, sep);
+        candidate.assign(dir.empty() ? "." : dir);
+        candidate += '/';
+        candidate += name;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        if (sep == std::string_view::npos) break;
+        dirs.remove_prefix(sep + 1);
+    }
+    return std::string(name);
+}
 
 struct Process::Impl {
     pid_t pid_ = -1;
+    int pidfd_ = -1;
     int exit_code_ = -1;
+    int term_signal_ = 0;
     bool has_exited_ = false;
 
     Impl() = default;
@@ -16,54 +132,93 @@ struct Process::Impl {
         if (pid_ > 0 && !has_exited_) {
             stop(5000);
         }
+        close_pidfd();
     }
 
-    bool start(std::span<const char *const> args) {
+    // `args[0]` must already be a path (see find_executable), no PATH search
+    // happens per spawn.
+    bool start(std::span<const char *const> args, const SpawnOptions &options) {
         if (args.empty()) return false;
 
-        pid_ = fork();
+        // a Process is reused when its instance gets restarted
+        close_pidfd();
+        exit_code_ = -1;
+        term_signal_ = 0;
+        has_exited_ = false;
+
+        // exec failures come back through this close-on-exec pipe
+        int error_pipe[2];
+        if (pipe2(error_pipe, O_CLOEXEC) != 0) return false;
+
+        // clone3 with CLONE_VFORK: the parent sleeps only until the child has
+        // exec'd and gets a pidfd atomically. Older kernels or seccomp
+        // profiles without clone3 fall back to fork + pidfd_open.
+        CloneArgs clone_args{};
+        clone_args.flags = CLONE_VFORK | CLONE_PIDFD;
+        clone_args.pidfd = reinterpret_cast<uintptr_t>(&pidfd_);
+        clone_args.exit_signal = SIGCHLD;
+        if (options.cgroup_fd >= 0) {
+            clone_args.flags |= k_clone_into_cgroup;
+            clone_args.cgroup = static_cast<uint64_t>(options.cgroup_fd);
+        }
+
+        bool join_cgroup = false;
+        pid_ = static_cast<pid_t>(syscall(SYS_clone3, &clone_args, sizeof(clone_args)));
+        // E2BIG/EINVAL: a kernel older than CLONE_INTO_CGROUP
+        if (pid_ < 0 && (errno == ENOSYS || errno == EPERM || errno == E2BIG || errno == EINVAL)) {
+            join_cgroup = options.cgroup_fd >= 0;
+            pidfd_ = -1;
+            pid_ = fork();
+            if (pid_ > 0) {
+                pidfd_ = static_cast<int>(syscall(SYS_pidfd_open, pid_, 0));
+            }
+        }
 
         if (pid_ == 0) {
-            // Child process
-            // Create new process group
-            setpgid(0, 0);
+            close(error_pipe[0]);
+            exec_child(args.data(), options, error_pipe[1], join_cgroup);
+        }
 
-            execvp(args[0], const_cast<char *const *>(args.data()));
+        close(error_pipe[1]);
+        if (pid_ < 0) {
+            close(error_pipe[0]);
+            pidfd_ = -1;
+            return false;
+        }
 
-            // If execvp returns, there was an error
-            _exit(1);
-        } else if (pid_ > 0) {
-            // Parent process
-            return true;
-        } else {
-            // Fork failed
+        int error = 0;
+        const auto got = read(error_pipe[0], &error, sizeof(error));
+        close(error_pipe[0]);
+        if (got == sizeof(error)) {
+            // exec failed, the child has already _exit'ed
+            int status;
+            waitpid(pid_, &status, 0);
+            close_pidfd();
+            pid_ = -1;
+            errno = error;
             return false;
         }
+        return true;
     }
 
     bool stop(int timeout_ms) {
         if (pid_ <= 0) return true;
+        if (has_exited_) return true;
 
         // Try graceful termination first
         kill(pid_, SIGTERM);
 
         // Wait for process to exit
-        int status;
         for (int i = 0; i < timeout_ms / 10; ++i) {
-            pid_t result = waitpid(pid_, &status, WNOHANG);
-            if (result == pid_) {
-                exit_code_ = WEXITSTATUS(status);
-                has_exited_ = true;
-                return true;
-            }
+            if (try_wait()) return true;
             usleep(10000); // 10ms
         }
 
         // Force kill if timeout
         kill(pid_, SIGKILL);
+        int status;
         waitpid(pid_, &status, 0);
-        exit_code_ = WEXITSTATUS(status);
-        has_exited_ = true;
+        record(status);
 
         return true;
     }
@@ -82,23 +237,67 @@ struct Process::Impl {
 
         int status;
         waitpid(pid_, &status, 0);
-        exit_code_ = WEXITSTATUS(status);
-        has_exited_ = true;
+        record(status);
 
         return exit_code_;
     }
 
+    bool signal(int sig) {
+        if (pid_ <= 0 || has_exited_) return false;
+        return kill(pid_, sig) == 0;
+    }
+
+    bool try_wait() {
+        if (pid_ <= 0) return false;
+        if (has_exited_) return true;
+
+        // The child stays a zombie until reaped here, so its pid cannot be
+        // recycled between the pidfd wakeup and this call.
+        int status;
+        if (waitpid(pid_, &status, WNOHANG) != pid_) return false;
+        record(status);
+        return true;
+    }
+
     bool is_valid() const {
         return pid_ > 0;
     }
+
+    void adopt(int pid, int pidfd) {
+        close_pidfd();
+        pid_ = pid;
+        pidfd_ = pidfd >= 0 ? pidfd : static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        exit_code_ = -1;
+        term_signal_ = 0;
+        has_exited_ = false;
+    }
+
+private:
+    void record(int status) {
+        if (WIFSIGNALED(status)) {
+            term_signal_ = WTERMSIG(status);
+            exit_code_ = 128 + term_signal_;
+        } else {
+            exit_code_ = WEXITSTATUS(status);
+        }
+        has_exited_ = true;
+        close_pidfd();
+    }
+
+    void close_pidfd() {
+        if (pidfd_ >= 0) {
+            close(pidfd_);
+            pidfd_ = -1;
+        }
+    }
 };
 
 Process::Process() {}
 
 Process::~Process() = default;
 
-bool Process::start(std::span<const char *const> args) {
-    return impl<Process::Impl>()->start(args);
+bool Process::start(std::span<const char *const> args, const SpawnOptions &options) {
+    return impl<Process::Impl>()->start(args, options);
 }
 
 bool Process::stop(int timeout_ms) {
@@ -117,4 +316,32 @@ bool Process::is_valid() const {
     return impl<Process::Impl>()->is_valid();
 }
 
+int Process::pid() const {
+    return impl<Process::Impl>()->pid_;
+}
+
+int Process::pidfd() const {
+    return impl<Process::Impl>()->pidfd_;
+}
+
+bool Process::signal(int sig) {
+    return impl<Process::Impl>()->signal(sig);
+}
+
+bool Process::try_wait() {
+    return impl<Process::Impl>()->try_wait();
+}
+
+int Process::exit_code() const {
+    return impl<Process::Impl>()->exit_code_;
+}
+
+int Process::term_signal() const {
+    return impl<Process::Impl>()->term_signal_;
+}
+
+void Process::adopt(int pid, int pidfd) {
+    impl<Process::Impl>()->adopt(pid, pidfd);
+}
+
 #endif // !_WIN32
\ No newline at end of file
@@ -6,6 +6,11 @@
 #include <string>
 #include <windows.h>
 
+std::string find_executable(std::string_view name) {
+    // CreateProcess does its own search
+    return std::string(name);
+}
+
 struct Process::Impl {
     HANDLE job_handle_ = nullptr;
     HANDLE process_handle_ = nullptr;
@@ -162,7 +167,7 @@ Process::Process() {}
 
 Process::~Process() = default;
 
-bool Process::start(std::span<const char *const> args) {
+bool Process::start(std::span<const char *const> args, const SpawnOptions &) {
     return impl<Process::Impl>()->start(args);
 }
 
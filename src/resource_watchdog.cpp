@@ -0,0 +1,149 @@
+#ifndef _WIN32
+
+#include "resource_watchdog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include "process/trace.h"
+#include "util/print.hpp"
+
+void ResourceWatchdog::attach(EventLoop &loop) {
+    loop_ = &loop;
+    loop.reserve(1);
+    arm();
+}
+
+void ResourceWatchdog::set_targets(std::vector<Target> targets, int interval_ms) {
+    std::unordered_map<std::string_view, const Watch *> old_by_name;
+    old_by_name.reserve(watches_.size());
+    for (const auto &old : watches_) {
+        old_by_name.emplace(old.target.instance, &old);
+    }
+    std::vector<Watch> watches(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto &watch = watches[i];
+        watch.target = std::move(targets[i]);
+        if (const auto found = old_by_name.find(watch.target.instance); found != old_by_name.end()) {
+            const auto *old = found->second;
+            watch.index = old->index;
+            watch.restarted = old->restarted;
+            watch.reported = old->reported;
+        }
+    }
+    watches_ = std::move(watches);
+    breached_.clear();
+    breached_.reserve(watches_.size());
+    interval_ms_ = watches_.empty() ? 0 : interval_ms;
+    arm();
+}
+
+void ResourceWatchdog::arm() {
+    if (!loop_ || interval_ms_ <= 0 || armed_) return;
+    armed_ = true;
+    next_ = EventLoop::Clock::now() + std::chrono::milliseconds(interval_ms_);
+    loop_->schedule(next_, make_token(Source::LIMITS));
+}
+
+std::span<const std::string_view> ResourceWatchdog::on_due(ProcessManager &manager) {
+    breached_.clear();
+    if (interval_ms_ <= 0) {
+        armed_ = false;
+        return {};
+    }
+    const auto now = EventLoop::Clock::now();
+    if (now < next_) return {};
+    next_ = std::max(next_ + std::chrono::milliseconds(interval_ms_), now);
+    loop_->schedule(next_, make_token(Source::LIMITS));
+
+    manager.sample_usage();
+    for (auto &watch : watches_) {
+        if (!locate(watch, manager)) continue;
+        const auto status = manager.status(watch.index);
+        if (status.state != InstanceState::RUNNING || status.stopping) {
+            watch.pid = -1;
+            continue;
+        }
+        check(watch, status, now);
+    }
+    return breached_;
+}
+
+// the cached index is right unless a reload moved the instance
+bool ResourceWatchdog::locate(Watch &watch, const ProcessManager &manager) const {
+    if (watch.index < manager.size() && manager.status(watch.index).name == watch.target.instance) return true;
+    const int index = manager.find(watch.target.instance);
+    if (index < 0) return false;
+    watch.index = static_cast<uint32_t>(index);
+    return true;
+}
+
+void ResourceWatchdog::check(Watch &watch, const InstanceStatus &status, EventLoop::Clock::time_point now) {
+    using namespace std::chrono;
+    const auto &limits = watch.target.limits;
+    const auto &usage = status.usage;
+    if (status.pid != watch.pid) {
+        // a fresh child starts with a clean record
+        watch.pid = status.pid;
+        watch.over = 0;
+        watch.window_start = now;
+        watch.window_cpu_ms = usage.cpu_ms;
+    }
+
+    char reason[96];
+    reason[0] = '\0';
+    int value = 0;
+    if (limits.rss_bytes > 0 && usage.rss_bytes > limits.rss_bytes) {
+        value = static_cast<int>(usage.rss_bytes >> 20);
+        std::snprintf(reason, sizeof(reason), "rss %d MB > %lld MB", value,
+                      static_cast<long long>(limits.rss_bytes >> 20));
+    } else if (limits.fds > 0 && usage.fds > limits.fds) {
+        value = usage.fds;
+        std::snprintf(reason, sizeof(reason), "%d fds > %d", value, limits.fds);
+    } else if (limits.threads > 0 && usage.threads > limits.threads) {
+        value = usage.threads;
+        std::snprintf(reason, sizeof(reason), "%d threads > %d", value, limits.threads);
+    }
+    watch.over = reason[0] ? watch.over + 1 : 0;
+    if (watch.over >= limits.samples) {
+        const auto length = std::strlen(reason);
+        std::snprintf(reason + length, sizeof(reason) - length, " for %d samples", watch.over);
+    } else {
+        reason[0] = '\0';
+    }
+
+    // CPU is judged per window, not per sample, so bursts average out
+    const auto elapsed = duration_cast<milliseconds>(now - watch.window_start).count();
+    if (limits.cpu_percent > 0 && elapsed >= limits.cpu_window_ms && elapsed > 0) {
+        const auto percent = static_cast<int>((usage.cpu_ms - watch.window_cpu_ms) * 100 / elapsed);
+        if (!reason[0] && percent > limits.cpu_percent) {
+            value = percent;
+            std::snprintf(reason, sizeof(reason), "cpu %d%% > %d%% over %lld s", percent, limits.cpu_percent,
+                          static_cast<long long>(elapsed / 1000));
+        }
+        watch.window_start = now;
+        watch.window_cpu_ms = usage.cpu_ms;
+    }
+    if (!reason[0]) return;
+
+    const auto since = duration_cast<milliseconds>(now - watch.restarted).count();
+    if (watch.restarted != EventLoop::Clock::time_point{} && since < limits.cooldown_ms) {
+        if (!watch.reported) {
+            print("Process ", status.name, " is over its limits (", reason, "), next restart allowed in ",
+                  NumStr((limits.cooldown_ms - since + 999) / 1000), " s\n");
+            watch.reported = true;
+        }
+        return;
+    }
+    print("Process ", status.name, " is over its limits (", reason, "), restarting it\n");
+    tracer().record(TraceKind::LIMIT, status.name, value);
+    watch.restarted = now;
+    watch.reported = false;
+    watch.pid = -1;
+    breached_.push_back(watch.target.instance);
+}
+
+#endif // !_WIN32
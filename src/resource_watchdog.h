@@ -0,0 +1,70 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "process/event_loop.h"
+#include "process/process_manager.h"
+#include "util/trait.hpp"
+
+// Thresholds an instance's frpc has to stay below, 0 for no limit.
+struct ResourceLimits {
+    int64_t rss_bytes = 0;
+    int cpu_percent = 0; // of one core, averaged over cpu_window_ms
+    int cpu_window_ms = 300000;
+    int fds = 0;
+    int threads = 0;
+    int samples = 3; // consecutive samples over rss, fds or threads before a restart
+    int cooldown_ms = 600000; // least time between two restarts of one instance
+};
+
+// Restarts instances whose frpc leaks memory, descriptors or goroutines, or
+// spins on a core, before the host starts swapping. Every interval (one
+// Source::LIMITS deadline) the children are sampled from /proc, which is a
+// few pread(2) each, and compared against their limits. RSS, fds and
+// threads have to be over their limit for `samples` samples in a row, CPU
+// is the average over a whole window. A breach is logged with the sample
+// that triggered it; within the cooldown the instance is only reported.
+struct ResourceWatchdog : Unique {
+    struct Target {
+        std::string instance;
+        ResourceLimits limits;
+    };
+
+    void attach(EventLoop &loop);
+    // Watch exactly `targets` from now on, `interval_ms` <= 0 turns sampling
+    // off. Cooldowns of instances that stay are kept.
+    void set_targets(std::vector<Target> targets, int interval_ms);
+
+    // Source::LIMITS: the instances to restart.
+    std::span<const std::string_view> on_due(ProcessManager &manager);
+
+private:
+    struct Watch {
+        Target target;
+        uint32_t index = 0; // hint into the manager, checked by name
+        int pid = -1;       // the child the samples below belong to
+        int over = 0;
+        EventLoop::Clock::time_point window_start{};
+        int64_t window_cpu_ms = 0;
+        EventLoop::Clock::time_point restarted{};
+        bool reported = false; // breach within the cooldown already logged
+    };
+
+    void arm();
+    bool locate(Watch &watch, const ProcessManager &manager) const;
+    void check(Watch &watch, const InstanceStatus &status, EventLoop::Clock::time_point now);
+
+    EventLoop *loop_ = nullptr;
+    std::vector<Watch> watches_;
+    std::vector<std::string_view> breached_;
+    int interval_ms_ = 0;
+    bool armed_ = false;
+    EventLoop::Clock::time_point next_{};
+};
+
+#endif // !_WIN32
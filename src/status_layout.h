@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+// Layout of the status file multi-frp publishes with `status_file`. Shared
+// with readers: multi-frp-status includes this header, other languages can
+// map the file and read it with the offsets below (little endian, native
+// alignment). A change to the layout bumps k_status_version.
+//
+// The file is a StatusHeader followed by `capacity` StatusRecords, each on
+// its own cache lines. Every record is guarded by a seqlock: the writer
+// makes `seq` odd, updates the fields, then makes it even again. A reader
+// copies a record between two reads of `seq` and keeps the copy only when
+// both reads were the same even value; otherwise it retries.
+//
+// multi-frp never shrinks or truncates a published file. When it needs
+// more records or stops publishing, it clears `live`. A reader that sees
+// `live == 0` re-opens the path, which by then is either a new file (a new
+// inode) or the one a stopped supervisor left behind.
+
+inline constexpr char k_status_magic[8] = {'M', 'F', 'R', 'P', 'S', 'T', 'A', 'T'};
+inline constexpr uint32_t k_status_version = 2;
+
+// StatusRecord::name_hash: 64-bit FNV-1a of the full instance name, which
+// identifies a record even when `name` had to be truncated
+inline uint64_t status_name_hash(std::string_view name) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char c : name) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+struct alignas(64) StatusHeader {
+    char magic[8];                   //  0  k_status_magic, written last on creation
+    uint32_t version;                //  8
+    uint32_t header_size;            // 12  sizeof(StatusHeader)
+    uint32_t record_size;            // 16  sizeof(StatusRecord)
+    uint32_t capacity;               // 20  records in the file
+    std::atomic<uint32_t> count;     // 24  records in use, the rest are zero
+    std::atomic<uint32_t> live;      // 28  1 while this file is being updated
+    int32_t supervisor_pid;          // 32
+    uint32_t reserved;               // 36
+    int64_t supervisor_started_ms;   // 40  unix time
+    std::atomic<int64_t> updated_ms; // 48  unix time of the last publish
+};
+
+struct alignas(64) StatusRecord {
+    std::atomic<uint32_t> seq; //   0  odd while being written
+    uint8_t state;             //   4  InstanceState: 0 running, 1 backoff, 2 stopped,
+                               //      3 parked, 4 removed, 5 queued
+    uint8_t ready;             //   5
+    uint8_t stopping;          //   6  SIGTERM sent, exit not seen yet
+    uint8_t reserved;          //   7
+    int32_t pid;               //   8  -1 unless running
+    int32_t restarts;          //  12
+    int32_t last_exit_code;    //  16  -1 until the first exit
+    int32_t last_signal;       //  20
+    int64_t started_ms;        //  24  unix time of the last spawn, 0 before
+    int64_t exited_ms;         //  32  unix time of the last exit, 0 before
+    int64_t ready_ms;          //  40  unix time it became ready, 0 unless ready
+    int64_t changed_ms;        //  48  unix time of this record's last update
+    uint64_t name_hash;        //  56  status_name_hash() of the full name
+    char name[64];             //  64  NUL terminated, truncated to 63 bytes
+};
+
+static_assert(sizeof(StatusHeader) == 64);
+static_assert(sizeof(StatusRecord) == 128);
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free);
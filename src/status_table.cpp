@@ -0,0 +1,154 @@
+#ifndef _WIN32
+
+#include "status_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util/print.hpp"
+#include "util/unique_fd.hpp"
+
+namespace {
+
+int64_t unix_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// by hash, names that only differ past the stored prefix are different
+bool same_name(const StatusRecord &record, std::string_view name) {
+    return record.name_hash == status_name_hash(name);
+}
+
+bool unchanged(const StatusRecord &record, const InstanceStatus &status) {
+    return record.state == static_cast<uint8_t>(status.state) && record.ready == status.ready &&
+           record.stopping == status.stopping && record.pid == status.pid && record.restarts == status.restarts &&
+           record.last_exit_code == status.last_exit_code && record.last_signal == status.last_signal &&
+           same_name(record, status.name);
+}
+
+} // namespace
+
+StatusTable::~StatusTable() {
+    close();
+}
+
+void StatusTable::configure(const std::string &path) {
+    if (path == path_) return;
+    close();
+    path_ = path;
+}
+
+bool StatusTable::create(size_t capacity) {
+    const auto size = sizeof(StatusHeader) + capacity * sizeof(StatusRecord);
+    const auto temp = path_ + ".tmp";
+    const UniqueFd fd(open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd || ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+        print("Failed to create status file: ", temp, "\n");
+        return false;
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (memory == MAP_FAILED) {
+        print("Failed to map status file: ", temp, "\n");
+        unlink(temp.c_str());
+        return false;
+    }
+
+    // a fresh file is all zeroes: every record is unused with an even seq
+    auto *header = static_cast<StatusHeader *>(memory);
+    header->version = k_status_version;
+    header->header_size = sizeof(StatusHeader);
+    header->record_size = sizeof(StatusRecord);
+    header->capacity = static_cast<uint32_t>(capacity);
+    header->supervisor_pid = getpid();
+    header->supervisor_started_ms = unix_ms();
+    header->live.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, k_status_magic, sizeof(k_status_magic));
+
+    if (rename(temp.c_str(), path_.c_str()) != 0) {
+        print("Failed to publish status file: ", path_, "\n");
+        munmap(memory, size);
+        unlink(temp.c_str());
+        return false;
+    }
+
+    // readers of the file replaced just now move over to the new one
+    const auto path = path_;
+    close();
+    path_ = path;
+    header_ = header;
+    records_ = reinterpret_cast<StatusRecord *>(header + 1);
+    mapped_size_ = size;
+    return true;
+}
+
+void StatusTable::close() {
+    if (header_) {
+        header_->live.store(0, std::memory_order_release);
+        munmap(header_, mapped_size_);
+    }
+    header_ = nullptr;
+    records_ = nullptr;
+    mapped_size_ = 0;
+    path_.clear();
+}
+
+void StatusTable::publish(const ProcessManager &manager) {
+    if (path_.empty()) return;
+    const auto count = manager.size();
+    if (header_ && manager.changes() == published_changes_) return;
+    if (!header_ || count > header_->capacity) {
+        // room to grow, so reloads adding instances rarely need a new file
+        if (!create(std::bit_ceil(std::max<size_t>(count * 2, 32)))) {
+            path_.clear();
+            return;
+        }
+    }
+    published_changes_ = manager.changes();
+
+    const auto now = unix_ms();
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto status = manager.status(i);
+        auto &record = records_[i];
+        if (unchanged(record, status)) continue;
+
+        const bool running = status.state == InstanceState::RUNNING;
+        const auto seq = record.seq.load(std::memory_order_relaxed);
+        record.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (record.pid > 0 && record.pid != status.pid) record.exited_ms = now;
+        if (running && record.pid != status.pid) record.started_ms = now - status.uptime_ms;
+        if (!status.ready) {
+            record.ready_ms = 0;
+        } else if (!record.ready) {
+            record.ready_ms = now;
+        }
+        record.state = static_cast<uint8_t>(status.state);
+        record.ready = status.ready;
+        record.stopping = status.stopping;
+        record.pid = status.pid;
+        record.restarts = status.restarts;
+        record.last_exit_code = status.last_exit_code;
+        record.last_signal = status.last_signal;
+        record.changed_ms = now;
+        const auto length = std::min(status.name.size(), sizeof(record.name) - 1);
+        std::memcpy(record.name, status.name.data(), length);
+        std::memset(record.name + length, 0, sizeof(record.name) - length);
+        record.name_hash = status_name_hash(status.name);
+
+        record.seq.store(seq + 2, std::memory_order_release);
+    }
+    header_->count.store(static_cast<uint32_t>(count), std::memory_order_release);
+    header_->updated_ms.store(now, std::memory_order_release);
+}
+
+#endif // !_WIN32
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "process/process_manager.h"
+#include "status_layout.h"
+#include "util/trait.hpp"
+
+// Publishes every instance's status into a memory-mapped file (see
+// status_layout.h), so monitors poll it with plain loads instead of a
+// control socket round trip. Only records whose status changed are
+// rewritten, and nothing is done while the process manager reports no
+// change. Readers never block the supervisor.
+struct StatusTable : Unique {
+    ~StatusTable();
+
+    // Publish to `path` from now on, "" stops. The file is created on the
+    // next publish(); an unchanged path keeps the current file.
+    void configure(const std::string &path);
+    void publish(const ProcessManager &manager);
+    // Clear `live` and unmap; the file stays with the last status in it.
+    void close();
+
+private:
+    bool create(size_t capacity);
+
+    std::string path_;
+    StatusHeader *header_ = nullptr;
+    StatusRecord *records_ = nullptr;
+    size_t mapped_size_ = 0;
+    uint64_t published_changes_ = 0;
+};
+
+#endif // !_WIN32
@@ -0,0 +1,121 @@
+#ifndef _WIN32
+
+#include "upgrade.h"
+
+#include <algorithm>
+
+#include "util/print.hpp"
+
+bool RollingUpgrade::begin(ProcessManager &manager, std::string binary, int batch, const HandoverPolicy &policy,
+                           std::string &error) {
+    if (active()) {
+        error = "an upgrade is already running: ";
+        describe(error);
+        return false;
+    }
+
+    steps_.clear();
+    for (uint32_t i = 0; i < manager.size(); ++i) {
+        const auto status = manager.status(i);
+        if (status.state == InstanceState::REMOVED || manager.binary(i) == binary) continue;
+        steps_.push_back({std::string(status.name), std::string(manager.binary(i)), i});
+    }
+    if (steps_.empty()) {
+        error = "every instance already runs " + binary;
+        return false;
+    }
+
+    binary_ = std::move(binary);
+    batch_ = std::max(batch, 1);
+    policy_ = policy;
+    next_ = 0;
+    in_flight_.clear();
+    moved_.clear();
+    total_ = steps_.size();
+    failed_ = false;
+    rolling_back_ = false;
+    running_ = true;
+    print("Upgrading ", NumStr(static_cast<long long>(total_)), " instance(s) to ", binary_, ", ",
+          NumStr(batch_), " at a time\n");
+    launch(manager);
+    return true;
+}
+
+void RollingUpgrade::describe(std::string &out) const {
+    out += NumStr(static_cast<long long>(moved_.size()));
+    out += '/';
+    out += NumStr(static_cast<long long>(total_));
+    out += rolling_back_ ? " being moved back from " : " moved to ";
+    out += binary_;
+}
+
+// the cached index is right unless a reload moved the instance
+bool RollingUpgrade::locate(Step &step, const ProcessManager &manager) const {
+    if (step.index < manager.size() && manager.status(step.index).name == step.instance) return true;
+    const int index = manager.find(step.instance);
+    if (index < 0) return false;
+    step.index = static_cast<uint32_t>(index);
+    return true;
+}
+
+void RollingUpgrade::launch(ProcessManager &manager) {
+    while (!failed_ && next_ < steps_.size() && in_flight_.size() < static_cast<size_t>(batch_)) {
+        const auto position = next_++;
+        auto &step = steps_[position];
+        // removed by a reload meanwhile, nothing to move
+        if (!locate(step, manager)) continue;
+        const auto &target = rolling_back_ ? step.from : binary_;
+        if (manager.begin_handover(step.index, target, policy_)) {
+            in_flight_.push_back(position);
+        } else if (!rolling_back_) {
+            print("Upgrade of ", step.instance, " is not possible right now\n");
+            failed_ = true;
+        } else {
+            print("Instance ", step.instance, " could not be moved back and keeps running ", binary_, "\n");
+        }
+    }
+}
+
+RollingUpgrade::Outcome RollingUpgrade::poll(ProcessManager &manager) {
+    if (!active()) return Outcome::NONE;
+
+    std::erase_if(in_flight_, [&](size_t position) {
+        auto &step = steps_[position];
+        if (!locate(step, manager)) return true;
+        const auto handover = manager.handover(step.index);
+        if (handover == Handover::STARTING || handover == Handover::SWITCHING) return false;
+        if (handover == Handover::DONE) {
+            if (!rolling_back_) moved_.push_back(step);
+        } else if (!rolling_back_) {
+            failed_ = true;
+        } else {
+            print("Instance ", step.instance, " could not be moved back and keeps running ", binary_, "\n");
+        }
+        return true;
+    });
+    launch(manager);
+    if (!in_flight_.empty() || (!failed_ && next_ < steps_.size())) return Outcome::NONE;
+
+    if (failed_ && !rolling_back_) {
+        // wait for the handovers in flight, then go back the same way
+        print("Upgrade to ", binary_, " failed, moving ", NumStr(static_cast<long long>(moved_.size())),
+              " instance(s) back\n");
+        steps_ = std::move(moved_);
+        moved_.clear();
+        next_ = 0;
+        failed_ = false;
+        rolling_back_ = true;
+        launch(manager);
+        if (!in_flight_.empty() || next_ < steps_.size()) return Outcome::NONE;
+    }
+    running_ = false;
+    if (rolling_back_) {
+        print("Upgrade to ", binary_, " rolled back\n");
+        return Outcome::ROLLED_BACK;
+    }
+    print("Upgrade to ", binary_, " complete, ", NumStr(static_cast<long long>(moved_.size())),
+          " instance(s) moved\n");
+    return Outcome::DONE;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef _WIN32
+
+#include <string>
+#include <vector>
+
+#include "process/process_manager.h"
+#include "util/trait.hpp"
+
+// Moves every instance to a new frpc binary, `batch` at a time, each one
+// through a ProcessManager handover: the new binary runs next to the old
+// one until it is ready, so no tunnel goes down for the switch and at most
+// `batch` instances are between two binaries at any moment. The first
+// failed handover ends the rollout; the instances that were already moved
+// are handed back to the binary they ran before, the same way.
+struct RollingUpgrade : Unique {
+    enum class Outcome : unsigned char {
+        NONE, // still running, or nothing to do
+        DONE, // every instance runs the new binary
+        ROLLED_BACK,
+    };
+
+    // false with the reason in `error` while another rollout is running or
+    // when every instance already runs `binary`
+    bool begin(ProcessManager &manager, std::string binary, int batch, const HandoverPolicy &policy,
+               std::string &error);
+    bool active() const { return running_; }
+    const std::string &binary() const { return binary_; }
+    // "3/50 moved to /usr/bin/frpc-0.61", for the control socket
+    void describe(std::string &out) const;
+
+    // After every batch of events: collect finished handovers and begin the
+    // next ones. Reports the end of the rollout once.
+    Outcome poll(ProcessManager &manager);
+
+private:
+    struct Step {
+        std::string instance;
+        std::string from; // binary before the upgrade
+        uint32_t index = 0; // hint into the manager, checked by name
+    };
+
+    bool locate(Step &step, const ProcessManager &manager) const;
+    void launch(ProcessManager &manager);
+
+    std::string binary_;
+    int batch_ = 1;
+    HandoverPolicy policy_;
+    std::vector<Step> steps_; // of the current direction
+    size_t next_ = 0;
+    std::vector<size_t> in_flight_; // into steps_
+    std::vector<Step> moved_; // handed over to binary_
+    size_t total_ = 0;
+    bool running_ = false;
+    bool failed_ = false;
+    bool rolling_back_ = false;
+};
+
+#endif // !_WIN32
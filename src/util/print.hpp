@@ -1,24 +1,54 @@
 #pragma once
 
 #include <string_view>
+#include <charconv>
 #include <cstdio>
 #include <cstring>
 
+// decimal rendering of an integer on the stack, so numbers can be passed to print()
+struct NumStr {
+    char buffer[24];
+    size_t length = 0;
+
+    explicit NumStr(long long value) {
+        length = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr - buffer;
+    }
+
+    operator std::string_view() const { return {buffer, length}; }
+};
+
 // print a bunch of strings at once
-// first gather all the length of the strings to allocate a buffer
-// then call write to print them all at once
+// the pieces are gathered into a stack buffer and handed to a single fwrite,
+// so printing never touches the heap; a message too long for the buffer is
+// written piece by piece under the stream lock instead
 template <std::convertible_to<std::string_view>... Args>
 constexpr void fprint(FILE *file, Args &&...args) {
+    constexpr size_t k_buffer_size = 1024;
+    const std::string_view pieces[] = {std::string_view(args)...};
     const auto total_size = (std::string_view(args).size() + ...);
-    char *buffer = new char[total_size + 1];
-    char *ptr = buffer;
-    for (const auto &str : {std::string_view(args)...}) {
-        std::memcpy(ptr, str.data(), str.size());
-        ptr += str.size();
+    if (total_size <= k_buffer_size) {
+        char buffer[k_buffer_size];
+        char *ptr = buffer;
+        for (const auto &str : pieces) {
+            std::memcpy(ptr, str.data(), str.size());
+            ptr += str.size();
+        }
+        std::fwrite(buffer, 1, total_size, file);
+        return;
+    }
+#ifdef _WIN32
+    _lock_file(file);
+#else
+    flockfile(file);
+#endif
+    for (const auto &str : pieces) {
+        std::fwrite(str.data(), 1, str.size(), file);
     }
-    buffer[total_size] = '\0';
-    std::fwrite(buffer, 1, total_size, file);
-    delete[] buffer;
+#ifdef _WIN32
+    _unlock_file(file);
+#else
+    funlockfile(file);
+#endif
 }
 
 template <std::convertible_to<std::string_view>... Args>
@@ -0,0 +1,156 @@
+// fake-frpc: behaves like an frpc process without talking to any server.
+// Takes `-c FILE` like frpc; FILE holds `key = value` lines (a TOML subset):
+//
+//   mode = "run"               # run | exit | crash | slow-term | ignore-term
+//   after_ms = 0               # exit / crash this long after start
+//   exit_code = 0              # for mode "exit"
+//   signal = 11                # for mode "crash"
+//   term_delay_ms = 2000       # mode "slow-term": time between SIGTERM and exit
+//   flood_bytes_per_sec = 0    # write log lines at about this rate
+//   login_ms = 0               # delay of the "login to server success" line
+//
+// Unknown keys are ignored, so a real frpc config works too (mode "run").
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+enum class Mode {
+    RUN,
+    EXIT,
+    CRASH,
+    SLOW_TERM,
+    IGNORE_TERM,
+};
+
+struct Behaviour {
+    Mode mode = Mode::RUN;
+    int after_ms = 0;
+    int exit_code = 0;
+    int signal = SIGSEGV;
+    int term_delay_ms = 2000;
+    long flood_bytes_per_sec = 0;
+    int login_ms = 0;
+};
+
+volatile sig_atomic_t g_terminate = 0;
+
+void on_term(int) {
+    g_terminate = 1;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '"')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '"' || text.back() == '\r')) text.remove_suffix(1);
+    return text;
+}
+
+bool load(const char *path, Behaviour &behaviour) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        const auto text = std::string_view(line).substr(0, line.find('#'));
+        const auto equals = text.find('=');
+        if (equals == std::string_view::npos) continue;
+        const auto key = trim(text.substr(0, equals));
+        const auto value = std::string(trim(text.substr(equals + 1)));
+        if (key == "mode") {
+            if (value == "exit") behaviour.mode = Mode::EXIT;
+            else if (value == "crash") behaviour.mode = Mode::CRASH;
+            else if (value == "slow-term") behaviour.mode = Mode::SLOW_TERM;
+            else if (value == "ignore-term") behaviour.mode = Mode::IGNORE_TERM;
+            else behaviour.mode = Mode::RUN;
+        } else if (key == "after_ms") {
+            behaviour.after_ms = std::atoi(value.c_str());
+        } else if (key == "exit_code") {
+            behaviour.exit_code = std::atoi(value.c_str());
+        } else if (key == "signal") {
+            behaviour.signal = std::atoi(value.c_str());
+        } else if (key == "term_delay_ms") {
+            behaviour.term_delay_ms = std::atoi(value.c_str());
+        } else if (key == "flood_bytes_per_sec") {
+            behaviour.flood_bytes_per_sec = std::atol(value.c_str());
+        } else if (key == "login_ms") {
+            behaviour.login_ms = std::atoi(value.c_str());
+        }
+    }
+    return true;
+}
+
+[[noreturn]] void crash(int sig) {
+    // the signal may be blocked or ignored in what we inherited
+    std::signal(sig, SIG_DFL);
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, nullptr);
+    std::raise(sig);
+    std::_Exit(128 + sig);
+}
+
+void say(std::string_view text) {
+    [[maybe_unused]] auto _ = write(STDOUT_FILENO, text.data(), text.size());
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const char *config = nullptr;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "-c") == 0) config = argv[i + 1];
+    }
+    Behaviour behaviour;
+    if (!config || !load(config, behaviour)) {
+        std::fprintf(stderr, "usage: fake-frpc -c FILE\n");
+        return 2;
+    }
+
+    switch (behaviour.mode) {
+        case Mode::IGNORE_TERM: std::signal(SIGTERM, SIG_IGN); break;
+        default: std::signal(SIGTERM, on_term); break;
+    }
+    std::signal(SIGINT, on_term);
+    say("[I] [root.go:220] [fake] start frpc service for config file\n");
+
+    using namespace std::chrono;
+    const auto started = steady_clock::now();
+    const auto tick = milliseconds(10);
+    // one line every tick carries the configured rate
+    std::string flood;
+    if (behaviour.flood_bytes_per_sec > 0) {
+        flood.assign(static_cast<size_t>(std::max(behaviour.flood_bytes_per_sec / 100, 2L)) - 1, 'x');
+        flood += '\n';
+    }
+
+    bool logged_in = false;
+    while (!g_terminate) {
+        const auto elapsed = steady_clock::now() - started;
+        if (!logged_in && elapsed >= milliseconds(behaviour.login_ms)) {
+            // what a real frpc prints once it is connected
+            say("[I] [service.go:301] [fake] login to server success, get run id [fake]\n");
+            logged_in = true;
+        }
+        const bool due = elapsed >= milliseconds(behaviour.after_ms);
+        if (due && behaviour.mode == Mode::EXIT) return behaviour.exit_code;
+        if (due && behaviour.mode == Mode::CRASH) crash(behaviour.signal);
+        if (!flood.empty()) say(flood);
+        std::this_thread::sleep_for(tick);
+    }
+
+    if (behaviour.mode == Mode::SLOW_TERM) {
+        std::this_thread::sleep_for(milliseconds(behaviour.term_delay_ms));
+    }
+    say("[I] [fake] exit\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+// notify-listen: stands in for systemd's side of the notify protocol. Binds a
+// datagram socket, runs COMMAND with $NOTIFY_SOCKET (and $WATCHDOG_USEC when
+// asked to) pointing at it, and prints every message it receives with the
+// time since launch, until COMMAND exits.
+//
+//   notify-listen [--watchdog-usec N] COMMAND [ARGS...]
+//
+// Missing a WATCHDOG=1 for longer than the interval is reported, as systemd
+// would kill the service then.
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    long long watchdog_usec = 0;
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "--watchdog-usec") == 0) {
+        watchdog_usec = std::atoll(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        std::fprintf(stderr, "usage: notify-listen [--watchdog-usec N] COMMAND [ARGS...]\n");
+        return 2;
+    }
+
+    const std::string path = "/tmp/notify-listen." + std::to_string(getpid());
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        std::perror("notify-listen: bind");
+        return 1;
+    }
+
+    using namespace std::chrono;
+    const auto started = steady_clock::now();
+    const pid_t child = fork();
+    if (child == 0) {
+        setenv("NOTIFY_SOCKET", path.c_str(), 1);
+        if (watchdog_usec > 0) setenv("WATCHDOG_USEC", std::to_string(watchdog_usec).c_str(), 1);
+        execvp(argv[first], argv + first);
+        std::perror("notify-listen: exec");
+        _exit(127);
+    }
+
+    // forward ^C and friends, the child decides when we are done
+    std::signal(SIGINT, SIG_IGN);
+    std::signal(SIGTERM, SIG_IGN);
+
+    auto last_ping = started;
+    int status = 0;
+    while (waitpid(child, &status, WNOHANG) == 0) {
+        pollfd ready{fd, POLLIN, 0};
+        if (poll(&ready, 1, 100) > 0) {
+            char message[4096];
+            const auto got = recv(fd, message, sizeof(message) - 1, 0);
+            if (got <= 0) continue;
+            message[got] = '\0';
+            const auto now = steady_clock::now();
+            if (std::strstr(message, "WATCHDOG=1")) last_ping = now;
+            std::fprintf(stderr, "[notify +%lldms] %s\n",
+                         static_cast<long long>(duration_cast<milliseconds>(now - started).count()), message);
+        }
+        if (watchdog_usec > 0 && steady_clock::now() - last_ping > microseconds(watchdog_usec)) {
+            std::fprintf(stderr, "[notify] watchdog timeout, systemd would kill the service now\n");
+            last_ping = steady_clock::now();
+        }
+    }
+
+    unlink(path.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
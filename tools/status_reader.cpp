@@ -0,0 +1,214 @@
+// multi-frp-status: reads the status file multi-frp publishes with
+// `status_file` (layout in src/status_layout.h) without talking to the
+// supervisor at all, so it can be polled as often as a monitor likes.
+//
+//   multi-frp-status [--watch MS] FILE [INSTANCE]
+//
+// Prints one line per instance, or only INSTANCE. Exits with 0 when the
+// supervisor is alive and every printed instance is running, 1 when not,
+// 2 when the file cannot be read. With --watch it prints again every MS
+// milliseconds until interrupted, re-opening the file whenever multi-frp
+// replaced it or restarted. A record that stays mid-update (a supervisor
+// killed while publishing) is shown as torn rather than waited on.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "status_layout.h"
+
+namespace {
+
+const char *k_state_names[] = {"running", "backoff", "stopped", "parked", "removed", "queued"};
+constexpr uint8_t k_running = 0;
+constexpr uint8_t k_removed = 4;
+
+struct Snapshot {
+    uint8_t state, ready, stopping;
+    int32_t pid, restarts, last_exit_code, last_signal;
+    int64_t started_ms, exited_ms, ready_ms;
+    uint64_t name_hash;
+    char name[64];
+    bool torn; // no consistent copy within k_read_attempts
+};
+
+// a live writer holds a record for well under a microsecond
+constexpr int k_read_attempts = 10000;
+
+struct Mapping {
+    const StatusHeader *header = nullptr;
+    size_t size = 0;
+    ino_t inode = 0;
+
+    ~Mapping() { reset(); }
+    void reset() {
+        if (header) munmap(const_cast<StatusHeader *>(header), size);
+        header = nullptr;
+    }
+};
+
+bool map_file(const char *path, Mapping &mapping) {
+    mapping.reset();
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::fprintf(stderr, "multi-frp-status: %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+    struct stat st{};
+    fstat(fd, &st);
+    const auto size = static_cast<size_t>(st.st_size);
+    void *memory = size >= sizeof(StatusHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::fprintf(stderr, "multi-frp-status: %s: not a status file\n", path);
+        return false;
+    }
+
+    const auto *header = static_cast<const StatusHeader *>(memory);
+    const bool valid = std::memcmp(header->magic, k_status_magic, sizeof(k_status_magic)) == 0 &&
+                       header->version == k_status_version && header->record_size == sizeof(StatusRecord) &&
+                       sizeof(StatusHeader) + size_t{header->capacity} * sizeof(StatusRecord) <= size;
+    mapping.header = header;
+    mapping.size = size;
+    mapping.inode = st.st_ino;
+    if (!valid) {
+        std::fprintf(stderr, "multi-frp-status: %s: unsupported status file\n", path);
+        mapping.reset();
+    }
+    return valid;
+}
+
+// the seqlock read side: retry until the copy was not torn by a writer, or
+// give up on a writer that is not coming back
+Snapshot read_record(const StatusRecord &record) {
+    Snapshot copy{};
+    copy.torn = true;
+    for (int attempt = 0; attempt < k_read_attempts; ++attempt) {
+        const auto before = record.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        copy.state = record.state;
+        copy.ready = record.ready;
+        copy.stopping = record.stopping;
+        copy.pid = record.pid;
+        copy.restarts = record.restarts;
+        copy.last_exit_code = record.last_exit_code;
+        copy.last_signal = record.last_signal;
+        copy.started_ms = record.started_ms;
+        copy.exited_ms = record.exited_ms;
+        copy.ready_ms = record.ready_ms;
+        copy.name_hash = record.name_hash;
+        std::memcpy(copy.name, record.name, sizeof(copy.name));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.seq.load(std::memory_order_relaxed) == before) {
+            copy.torn = false;
+            break;
+        }
+    }
+    // best effort, to say which record it was
+    if (copy.torn) {
+        std::memcpy(copy.name, record.name, sizeof(copy.name));
+        copy.name_hash = record.name_hash;
+    }
+    copy.name[sizeof(copy.name) - 1] = '\0';
+    return copy;
+}
+
+int64_t unix_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// 0 healthy, 1 not, 2 unreadable
+int show(const char *path, const char *instance, Mapping &mapping) {
+    // multi-frp clears `live` before it replaces or leaves the file
+    struct stat st{};
+    if (!mapping.header || mapping.header->live.load(std::memory_order_acquire) == 0 ||
+        (stat(path, &st) == 0 && st.st_ino != mapping.inode)) {
+        if (!map_file(path, mapping)) return 2;
+    }
+
+    const auto &header = *mapping.header;
+    const bool alive = header.live.load(std::memory_order_acquire) != 0 &&
+                       (kill(header.supervisor_pid, 0) == 0 || errno == EPERM);
+    if (!alive) std::printf("supervisor %d is not running\n", header.supervisor_pid);
+
+    const auto count = std::min(header.count.load(std::memory_order_acquire), header.capacity);
+    const auto *records = reinterpret_cast<const StatusRecord *>(&header + 1);
+    const auto now = unix_ms();
+    bool healthy = alive;
+    bool found = instance == nullptr;
+    // the full name is only stored as a hash, long ones are matched by it
+    const auto wanted = instance ? status_name_hash(instance) : 0;
+    std::printf("NAME STATE PID UPTIME_S RESTARTS LAST_EXIT READY\n");
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto record = read_record(records[i]);
+        if (!record.torn && record.state == k_removed) continue;
+        if (instance && record.name_hash != wanted) continue;
+        found = true;
+        // a stored name that is only a prefix is marked as one
+        const char *cut = status_name_hash(record.name) == record.name_hash ? "" : "...";
+        if (record.torn) {
+            // the other fields may be half written
+            healthy = false;
+            std::printf("%s%s torn - - - - -\n", record.name, cut);
+            continue;
+        }
+        const bool running = record.state == k_running;
+        healthy = healthy && running;
+        char last_exit[16];
+        if (record.last_signal != 0) {
+            std::snprintf(last_exit, sizeof(last_exit), "SIG%d", record.last_signal);
+        } else {
+            std::snprintf(last_exit, sizeof(last_exit), "%d", record.last_exit_code);
+        }
+        std::printf("%s%s %s %d %lld %d %s %s\n", record.name, cut,
+                    record.stopping ? "stopping" : record.state < 6 ? k_state_names[record.state] : "unknown",
+                    record.pid, running ? static_cast<long long>((now - record.started_ms) / 1000) : 0LL,
+                    record.restarts, last_exit, record.ready ? "yes" : "no");
+    }
+    if (!found) {
+        std::printf("no instance named '%s'\n", instance);
+        return 1;
+    }
+    return healthy ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    long watch_ms = 0;
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "--watch") == 0) {
+        watch_ms = std::max(std::atol(argv[2]), 1L);
+        first = 3;
+    }
+    if (first >= argc || argc > first + 2) {
+        std::fprintf(stderr, "usage: multi-frp-status [--watch MS] FILE [INSTANCE]\n");
+        return 2;
+    }
+    const char *path = argv[first];
+    const char *instance = first + 1 < argc ? argv[first + 1] : nullptr;
+
+    Mapping mapping;
+    int result = show(path, instance, mapping);
+    while (watch_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(watch_ms));
+        std::printf("\n");
+        result = show(path, instance, mapping);
+        std::fflush(stdout);
+    }
+    return result;
+}
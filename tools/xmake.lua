@@ -0,0 +1,18 @@
+-- stand-in for frpc, used by the bench and for trying out supervisor features
+target("fake-frpc")
+    set_kind("binary")
+    set_default(false)
+    add_files("fake_frpc.cpp")
+
+-- stand-in for systemd's notify socket: `notify-listen multi-frp -c config.json`
+target("notify-listen")
+    set_kind("binary")
+    set_default(false)
+    add_files("notify_listen.cpp")
+
+-- reads the `status_file` multi-frp publishes: `multi-frp-status /run/multi-frp.status`
+target("multi-frp-status")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("$(projectdir)/src")
+    add_files("status_reader.cpp")